@@ -0,0 +1,181 @@
+#pragma once
+
+#include "small_vector.h"
+
+#include <cstddef>      // std::size_t, std::ptrdiff_t
+#include <cstdlib>      // std::malloc, std::free
+#include <new>          // std::bad_alloc, placement new
+
+// A bump allocator for memory that is all released at once, e.g. at the
+// end of a request. Memory comes from a list of malloc'd chunks; each
+// allocation just advances a pointer, and individual deallocation is not
+// supported. Not thread safe.
+class monotonic_arena {
+public:
+  explicit monotonic_arena(::std::size_t chunk_size = 64 * 1024) :
+    m_chunks(NULL),
+    m_current(NULL),
+    m_end(NULL),
+    m_chunk_size(chunk_size),
+    m_bytes_allocated(0),
+    m_chunk_allocations(0) {
+  }
+
+  ~monotonic_arena() {
+    free_chunks(m_chunks);
+  }
+
+  // Returns bytes of memory aligned to alignment, which must be a power
+  // of two no greater than that of max_align_t.
+  void* allocate(::std::size_t bytes, ::std::size_t alignment) {
+    // Aligning can step past the end of a nearly full chunk
+    char* p = align(m_current, alignment);
+    if (!m_current || p > m_end ||
+        bytes > static_cast< ::std::size_t>(m_end - p)) {
+      p = align(new_chunk(bytes + alignment), alignment);
+    }
+    m_current = p + bytes;
+    m_bytes_allocated += bytes;
+    return p;
+  }
+
+  // Releases everything allocated from the arena. If it took more than
+  // one chunk, they are replaced by a single chunk as big as all of
+  // them, so an arena reused for requests of about the same size stops
+  // touching malloc after the first.
+  void release() {
+    if (!m_chunks) {
+      return;
+    }
+    if (m_chunks->next) {
+      ::std::size_t total = 0;
+      for (chunk* c = m_chunks; c; c = c->next) {
+        total += c->size;
+      }
+      free_chunks(m_chunks);
+      m_chunks = NULL;
+      m_current = m_end = NULL;
+      new_chunk(total);
+    }
+    m_current = m_chunks->data();
+    m_end = m_chunks->data() + m_chunks->size;
+    m_bytes_allocated = 0;
+  }
+
+  // Bytes handed out since construction or the last release()
+  ::std::size_t bytes_allocated() const { return m_bytes_allocated; }
+
+  // Chunks taken from malloc since construction
+  ::std::size_t chunk_allocations() const { return m_chunk_allocations; }
+
+private:
+  struct chunk {
+    chunk* next;
+    ::std::size_t size;
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+  };
+
+  chunk* m_chunks;            // Most recently allocated chunk first
+  char* m_current;
+  char* m_end;
+  ::std::size_t m_chunk_size;
+  ::std::size_t m_bytes_allocated;
+  ::std::size_t m_chunk_allocations;
+
+  static char* align(char* p, ::std::size_t alignment) {
+    const ::std::size_t mask = alignment - 1;
+    return reinterpret_cast<char*>(
+      (reinterpret_cast< ::std::size_t>(p) + mask) & ~mask);
+  }
+
+  // Starts a new chunk with room for at least bytes, and returns its data
+  char* new_chunk(::std::size_t bytes) {
+    const ::std::size_t size = bytes > m_chunk_size ? bytes : m_chunk_size;
+    chunk* c = static_cast<chunk*>(::std::malloc(sizeof(chunk) + size));
+    if (!c) {
+      throw ::std::bad_alloc();
+    }
+    ++m_chunk_allocations;
+    c->next = m_chunks;
+    c->size = size;
+    m_chunks = c;
+    m_end = c->data() + size;
+    return c->data();
+  }
+
+  static void free_chunks(chunk* c) {
+    while (c) {
+      chunk* next = c->next;
+      ::std::free(c);
+      c = next;
+    }
+  }
+
+  monotonic_arena(const monotonic_arena&);
+  monotonic_arena& operator=(const monotonic_arena&);
+};
+
+// An allocator that takes its memory from a monotonic_arena. Spilling a
+// small_vector to the heap becomes a pointer bump, and deallocate() does
+// nothing; the memory comes back when the arena is released. The arena
+// must outlive every container using it.
+//
+// small_vectors of trivially destructible elements using this allocator
+// skip their destructor's work entirely.
+template <class T>
+class arena_allocator {
+public:
+  typedef T                   value_type;
+  typedef T*                  pointer;
+  typedef const T*            const_pointer;
+  typedef T&                  reference;
+  typedef const T&            const_reference;
+  typedef ::std::size_t       size_type;
+  typedef ::std::ptrdiff_t    difference_type;
+  template <class U>
+  struct rebind { typedef arena_allocator<U> other; };
+
+  // Deliberately not default constructible: every container must be
+  // told which arena to use.
+  explicit arena_allocator(monotonic_arena& arena) : m_arena(&arena) {}
+  template <class U>
+  arena_allocator(const arena_allocator<U>& rhs) : m_arena(&rhs.arena()) {}
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  pointer allocate(size_type n, const void* = 0) {
+    return static_cast<pointer>(m_arena->allocate(n * sizeof(T), alignment));
+  }
+  void deallocate(pointer, size_type) {}
+
+  size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+  void construct(pointer p, const T& value) { new (p) T(value); }
+  void destroy(pointer p) { p->~T(); }
+
+  monotonic_arena& arena() const { return *m_arena; }
+
+private:
+#if __cplusplus >= 201103L
+  static const ::std::size_t alignment = alignof(T);
+#else
+  static const ::std::size_t alignment = __alignof__(T);
+#endif
+
+  monotonic_arena* m_arena;
+};
+
+template <class T, class U>
+bool operator==(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) {
+  return &lhs.arena() == &rhs.arena();
+}
+template <class T, class U>
+bool operator!=(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) {
+  return &lhs.arena() != &rhs.arena();
+}
+
+template <class T>
+struct small_vector_allocator_is_monotonic< arena_allocator<T> > {
+  static const bool value = true;
+};
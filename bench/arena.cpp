@@ -0,0 +1,98 @@
+// Compares std::allocator against arena_allocator for request-shaped
+// work: each request builds a batch of short-lived small_vectors, most of
+// which stay small and some of which spill, then throws them all away.
+//
+// Usage: arena [requests]
+
+#include "small_vector.h"
+#include "arena_allocator.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+  using bench::lcg;
+  using bench::now;
+
+  // Three quarters of the vectors fit in 8 elements; the rest spill to
+  // anywhere up to 200.
+  unsigned pick_size(lcg& rng) {
+    const unsigned r = rng.next();
+    return r % 4 != 0 ? r % 9 : 9 + r % 192;
+  }
+
+  struct record {
+    int key;
+    int value;
+    double weight;
+  };
+
+  const unsigned VectorsPerRequest = 64;
+
+  // One request with the default allocator
+  long long request_std(lcg& rng) {
+    long long sum = 0;
+    for (unsigned v=0; v<VectorsPerRequest; ++v) {
+      small_vector<int, 8> ints;
+      small_vector<record, 4> records;
+      const unsigned n = pick_size(rng);
+      for (unsigned i=0; i<n; ++i) {
+        ints.push_back(i);
+        record r = { static_cast<int>(i), static_cast<int>(n), 0.5 };
+        records.push_back(r);
+      }
+      for (unsigned i=0; i<n; ++i) sum += ints[i] + records[i].value;
+    }
+    return sum;
+  }
+
+  // The same request with every vector in a per-request arena
+  long long request_arena(lcg& rng, monotonic_arena& arena) {
+    typedef small_vector<int, 8, arena_allocator<int> > int_vector;
+    typedef small_vector<record, 4, arena_allocator<record> > record_vector;
+    long long sum = 0;
+    for (unsigned v=0; v<VectorsPerRequest; ++v) {
+      int_vector ints((arena_allocator<int>(arena)));
+      record_vector records((arena_allocator<record>(arena)));
+      const unsigned n = pick_size(rng);
+      for (unsigned i=0; i<n; ++i) {
+        ints.push_back(i);
+        record r = { static_cast<int>(i), static_cast<int>(n), 0.5 };
+        records.push_back(r);
+      }
+      for (unsigned i=0; i<n; ++i) sum += ints[i] + records[i].value;
+    }
+    arena.release();
+    return sum;
+  }
+}
+
+int main(int argc, char** argv) {
+  const unsigned requests = argc > 1 ? std::strtoul(argv[1], NULL, 0)
+                                     : 200000;
+  std::printf("%u requests of %u vectors\n", requests, VectorsPerRequest);
+  std::printf("%-16s %12s %12s\n", "allocator", "ns/request", "checksum");
+
+  {
+    lcg rng(1);
+    long long sum = 0;
+    const double start = now();
+    for (unsigned r=0; r<requests; ++r) sum += request_std(rng);
+    const double elapsed = now() - start;
+    std::printf("%-16s %12.1f %12lld\n", "std::allocator",
+                elapsed * 1e9 / requests, sum);
+  }
+
+  {
+    lcg rng(1);
+    monotonic_arena arena;
+    long long sum = 0;
+    const double start = now();
+    for (unsigned r=0; r<requests; ++r) sum += request_arena(rng, arena);
+    const double elapsed = now() - start;
+    std::printf("%-16s %12.1f %12lld\n", "arena_allocator",
+                elapsed * 1e9 / requests, sum);
+  }
+  return 0;
+}
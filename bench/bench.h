@@ -0,0 +1,539 @@
+#pragma once
+
+// A minimal harness for the microbenchmarks: timing, calibration, and
+// keeping the optimizer from deleting the work being measured.
+//
+// measure(f) runs f in batches big enough to take at least
+// options::min_time seconds, repeats that options::repetitions times,
+// and returns the median batch's nanoseconds per call of f.
+//
+// A recorder does the same for named benchmarks, and with --json writes
+// every repetition of every benchmark to a file that bench/compare.py
+// can diff against another run.
+//
+// For timing single operations, ticks() is a cheap timestamp (the TSC on
+// x86, else clock_gettime), and latencies collects them for percentiles.
+//
+// counting_allocator keeps a running total of heap bytes, and
+// perf_counter reads a hardware event counter where the kernel allows.
+// With --counters, a recorder also counts cycles, instructions, cache,
+// branch and TLB misses per call of each benchmark, for whichever of
+// those events the kernel and CPU provide.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench {
+  inline double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  // A timestamp in arbitrary units; see ns_per_tick()
+  inline unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+  }
+
+  // Measured once, against the monotonic clock
+  inline double ns_per_tick() {
+    static double ns = 0;
+    if (ns == 0) {
+      const double start = now();
+      const unsigned long long start_ticks = ticks();
+      while (now() - start < 0.05) {
+      }
+      ns = (now() - start) * 1e9 / (ticks() - start_ticks);
+    }
+    return ns;
+  }
+
+  // Makes the compiler assume value is read, and memory written
+  template <class T>
+  inline void do_not_optimize(const T& value) {
+    __asm__ __volatile__("" : : "g"(&value) : "memory");
+  }
+
+  struct options {
+    options() : min_time(0.005), repetitions(5), filter(NULL), json(NULL),
+                counters(false) {}
+
+    // Parses [--min-time seconds] [--repetitions n] [--json file]
+    // [--counters] [filter], exiting with usage on anything else
+    options(int argc, char** argv) : min_time(0.005), repetitions(5),
+                                     filter(NULL), json(NULL),
+                                     counters(false) {
+      for (int i=1; i<argc; ++i) {
+        if (!std::strcmp(argv[i], "--min-time") && i + 1 < argc) {
+          min_time = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--repetitions") && i + 1 < argc) {
+          repetitions = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--json") && i + 1 < argc) {
+          json = argv[++i];
+        } else if (!std::strcmp(argv[i], "--counters")) {
+          counters = true;
+        } else if (argv[i][0] != '-' && !filter) {
+          filter = argv[i];
+        } else {
+          std::fprintf(stderr, "Usage: %s [--min-time seconds] "
+                       "[--repetitions n] [--json file] [--counters] "
+                       "[filter]\n",
+                       argv[0]);
+          std::exit(2);
+        }
+      }
+      if (repetitions < 1) {
+        repetitions = 1;
+      }
+    }
+
+    double min_time;
+    int repetitions;
+    const char* filter;     // Only run benchmarks whose name contains this
+    const char* json;       // Where a recorder writes its results, if set
+    bool counters;          // Whether a recorder counts hardware events
+
+    bool selected(const std::string& name) const {
+      return !filter || name.find(filter) != std::string::npos;
+    }
+  };
+
+  // Seconds taken by calling f iterations times
+  template <class F>
+  double time_batch(F& f, std::size_t iterations) {
+    const double start = now();
+    for (std::size_t i=0; i<iterations; ++i) {
+      f();
+    }
+    return now() - start;
+  }
+
+  // Calls of f in a batch that takes at least opts.min_time
+  template <class F>
+  std::size_t calibrate(F& f, const options& opts) {
+    std::size_t iterations = 1;
+    while (time_batch(f, iterations) < opts.min_time) {
+      iterations *= 2;
+    }
+    return iterations;
+  }
+
+  // Nanoseconds per call of f, for repetitions batches of iterations
+  template <class F>
+  std::vector<double> measure_samples(F& f, std::size_t iterations,
+                                      int repetitions) {
+    std::vector<double> samples;
+    for (int r=0; r<repetitions; ++r) {
+      samples.push_back(time_batch(f, iterations) * 1e9 / iterations);
+    }
+    return samples;
+  }
+
+  // Nanoseconds per call of f, once per repetition
+  template <class F>
+  std::vector<double> measure_samples(F f, const options& opts) {
+    return measure_samples(f, calibrate(f, opts), opts.repetitions);
+  }
+
+  inline double median(std::vector<double> samples) {
+    if (samples.empty()) {
+      return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    const std::size_t mid = samples.size() / 2;
+    return samples.size() % 2 ? samples[mid]
+                              : (samples[mid - 1] + samples[mid]) / 2;
+  }
+
+  // Nanoseconds per call of f
+  template <class F>
+  double measure(F f, const options& opts) {
+    return median(measure_samples(f, opts));
+  }
+
+  // A linear congruential generator, deterministic so that every
+  // configuration of a benchmark sees the same sizes and data
+  struct lcg {
+    explicit lcg(unsigned seed) : state(seed) {}
+    unsigned next() {
+      state = state * 1664525u + 1013904223u;
+      return state >> 8;
+    }
+    // In [0, 1)
+    double uniform() { return (next() & 0xffffff) / double(0x1000000); }
+    unsigned state;
+  };
+
+  // Heap bytes currently allocated through counting_allocator
+  inline long long& heap_bytes() {
+    static long long bytes = 0;
+    return bytes;
+  }
+
+  template <class T>
+  struct counting_allocator : std::allocator<T> {
+    template <class U>
+    struct rebind { typedef counting_allocator<U> other; };
+
+    counting_allocator() {}
+    template <class U>
+    counting_allocator(const counting_allocator<U>&) {}
+
+    T* allocate(std::size_t n, const void* = 0) {
+      heap_bytes() += n * sizeof(T);
+      return std::allocator<T>::allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) {
+      heap_bytes() -= n * sizeof(T);
+      std::allocator<T>::deallocate(p, n);
+    }
+  };
+
+  // Counts one hardware event in user space for the calling thread,
+  // e.g. perf_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES).
+  // Where perf_event_open isn't available or allowed, valid() is false
+  // and stop() returns 0.
+  class perf_counter {
+  public:
+    perf_counter(unsigned type, unsigned long long config) : m_fd(-1) {
+#if defined(__linux__)
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+      m_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+      (void)type;
+      (void)config;
+#endif
+    }
+
+    ~perf_counter() {
+#if defined(__linux__)
+      if (m_fd >= 0) close(m_fd);
+#endif
+    }
+
+    bool valid() const { return m_fd >= 0; }
+
+    void start() {
+#if defined(__linux__)
+      if (m_fd >= 0) {
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+    }
+
+    // The count since start(), scaled up if the kernel had to share the
+    // hardware counter with other events for part of the time
+    unsigned long long stop() {
+      unsigned long long count = 0;
+#if defined(__linux__)
+      if (m_fd >= 0) {
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        // The count, then the time enabled and the time running
+        unsigned long long values[3];
+        if (read(m_fd, values, sizeof(values)) == sizeof(values) &&
+            values[2] > 0) {
+          count = values[2] < values[1]
+                    ? static_cast<unsigned long long>(
+                        double(values[0]) * values[1] / values[2])
+                    : values[0];
+        }
+      }
+#endif
+      return count;
+    }
+
+  private:
+    int m_fd;
+
+    perf_counter(const perf_counter&);
+    perf_counter& operator=(const perf_counter&);
+  };
+
+  // The events a counter_set counts
+  enum counter_event {
+    cycles,
+    instructions,
+    l1d_misses,
+    llc_misses,
+    branch_misses,
+    dtlb_misses,
+    counter_events
+  };
+
+  inline const char* counter_name(int event) {
+    static const char* const names[counter_events] = {
+      "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+      "dtlb_misses"
+    };
+    return names[event];
+  }
+
+  // Counts every counter_event at once. The ones the kernel or CPU won't
+  // provide (no PMU in a VM, perf_event_paranoid too high) are skipped;
+  // if none are, available() is false and stop() counts nothing.
+  class counter_set {
+  public:
+    counter_set() {
+#if defined(__linux__)
+      const int C = PERF_TYPE_HW_CACHE;
+      const unsigned long long read_miss =
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      const unsigned types[counter_events] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, C, C, PERF_TYPE_HARDWARE, C
+      };
+      const unsigned long long configs[counter_events] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | read_miss,
+        PERF_COUNT_HW_CACHE_LL | read_miss,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_DTLB | read_miss
+      };
+#else
+      const unsigned types[counter_events] = { 0 };
+      const unsigned long long configs[counter_events] = { 0 };
+#endif
+      for (int e=0; e<counter_events; ++e) {
+        m_counters[e] = new perf_counter(types[e], configs[e]);
+        m_counts[e] = 0;
+      }
+    }
+
+    ~counter_set() {
+      for (int e=0; e<counter_events; ++e) {
+        delete m_counters[e];
+      }
+    }
+
+    bool available() const {
+      for (int e=0; e<counter_events; ++e) {
+        if (m_counters[e]->valid()) return true;
+      }
+      return false;
+    }
+    bool valid(int event) const { return m_counters[event]->valid(); }
+
+    void start() {
+      for (int e=0; e<counter_events; ++e) {
+        m_counters[e]->start();
+      }
+    }
+    void stop() {
+      for (int e=counter_events; e-- > 0; ) {
+        m_counts[e] = m_counters[e]->stop();
+      }
+    }
+
+    // The count between the last start() and stop()
+    unsigned long long count(int event) const { return m_counts[event]; }
+
+  private:
+    perf_counter* m_counters[counter_events];
+    unsigned long long m_counts[counter_events];
+
+    counter_set(const counter_set&);
+    counter_set& operator=(const counter_set&);
+  };
+
+  // Durations of single operations, in ticks
+  class latencies {
+  public:
+    latencies() : m_sorted(false) {}
+
+    void reserve(std::size_t n) { m_samples.reserve(n); }
+    void add(unsigned long long duration) {
+      m_samples.push_back(duration);
+      m_sorted = false;
+    }
+    std::size_t size() const { return m_samples.size(); }
+
+    // The duration that fraction of the samples took at most, in ns
+    double percentile(double fraction) {
+      if (m_samples.empty()) {
+        return 0;
+      }
+      sort();
+      std::size_t i = static_cast<std::size_t>(fraction * m_samples.size());
+      if (i >= m_samples.size()) {
+        i = m_samples.size() - 1;
+      }
+      return m_samples[i] * ns_per_tick();
+    }
+
+    double max() { return percentile(1); }
+
+    // Writes how many samples fall in each power-of-two range of ns
+    void print_histogram(FILE* out) {
+      sort();
+      std::size_t i = 0;
+      for (double limit = 1; i < m_samples.size(); limit *= 2) {
+        std::size_t n = 0;
+        for ( ; i < m_samples.size() &&
+                m_samples[i] * ns_per_tick() < limit; ++i) {
+          ++n;
+        }
+        if (n) {
+          std::fprintf(out, "    < %8.0f ns %10zu\n", limit, n);
+        }
+      }
+    }
+
+  private:
+    void sort() {
+      if (!m_sorted) {
+        std::sort(m_samples.begin(), m_samples.end());
+        m_sorted = true;
+      }
+    }
+
+    std::vector<unsigned long long> m_samples;
+    bool m_sorted;
+  };
+
+  // Measures named benchmarks, and writes them all to options::json, if
+  // given, when destroyed. With options::counters, each benchmark also
+  // gets one more batch with the hardware events counted.
+  class recorder {
+  public:
+    explicit recorder(const options& opts) : m_opts(opts), m_counters(NULL) {
+      if (opts.counters) {
+        m_counters = new counter_set;
+        if (!m_counters->available()) {
+          std::fprintf(stderr, "Hardware counters aren't available here; "
+                       "recording times only\n");
+        }
+      }
+    }
+
+    ~recorder() {
+      if (m_opts.json) {
+        write_json(m_opts.json);
+      }
+      delete m_counters;
+    }
+
+    // Median nanoseconds per call of f
+    template <class F>
+    double run(const std::string& name, F f) {
+      const std::size_t iterations = calibrate(f, m_opts);
+      result r;
+      r.name = name;
+      r.samples = measure_samples(f, iterations, m_opts.repetitions);
+      r.counted = m_counters && m_counters->available();
+      if (r.counted) {
+        m_counters->start();
+        time_batch(f, iterations);
+        m_counters->stop();
+        for (int e=0; e<counter_events; ++e) {
+          r.counts[e] = double(m_counters->count(e)) / iterations;
+        }
+      }
+      m_results.push_back(r);
+      return median(r.samples);
+    }
+
+    // Writes the events per call of each of the last n benchmarks, one
+    // line each, if they were counted
+    void print_counters(FILE* out, std::size_t n) const {
+      if (n > m_results.size()) n = m_results.size();
+      for (std::size_t i = m_results.size() - n; i < m_results.size(); ++i) {
+        const result& r = m_results[i];
+        if (!r.counted) continue;
+        std::fprintf(out, "  %s:", r.name.c_str());
+        for (int e=0; e<counter_events; ++e) {
+          if (m_counters->valid(e)) {
+            std::fprintf(out, " %s %.1f", counter_name(e), r.counts[e]);
+          }
+        }
+        std::fprintf(out, "\n");
+      }
+    }
+
+    void write_json(const char* path) const {
+      FILE* out = std::fopen(path, "w");
+      if (!out) {
+        std::perror(path);
+        return;
+      }
+      std::fprintf(out, "{\n  \"min_time\": %g,\n  \"repetitions\": %d,\n"
+                   "  \"benchmarks\": [", m_opts.min_time,
+                   m_opts.repetitions);
+      for (std::size_t i=0; i<m_results.size(); ++i) {
+        const result& r = m_results[i];
+        std::fprintf(out, "%s\n    {\"name\": \"", i ? "," : "");
+        for (std::size_t c=0; c<r.name.size(); ++c) {
+          if (r.name[c] == '"' || r.name[c] == '\\') std::fputc('\\', out);
+          std::fputc(r.name[c], out);
+        }
+        std::fprintf(out, "\", \"median_ns\": %.3f, \"samples_ns\": [",
+                     median(r.samples));
+        for (std::size_t s=0; s<r.samples.size(); ++s) {
+          std::fprintf(out, "%s%.3f", s ? ", " : "", r.samples[s]);
+        }
+        std::fprintf(out, "]");
+        if (r.counted) {
+          std::fprintf(out, ", \"counters\": {");
+          const char* separator = "";
+          for (int e=0; e<counter_events; ++e) {
+            if (m_counters->valid(e)) {
+              std::fprintf(out, "%s\"%s\": %.3f", separator, counter_name(e),
+                           r.counts[e]);
+              separator = ", ";
+            }
+          }
+          std::fprintf(out, "}");
+        }
+        std::fprintf(out, "}");
+      }
+      std::fprintf(out, "\n  ]\n}\n");
+      std::fclose(out);
+    }
+
+  private:
+    struct result {
+      std::string name;
+      std::vector<double> samples;
+      bool counted;
+      double counts[counter_events];    // Per call of f, if counted
+    };
+
+    const options& m_opts;
+    counter_set* m_counters;    // Only with options::counters
+    std::vector<result> m_results;
+
+    recorder(const recorder&);
+    recorder& operator=(const recorder&);
+  };
+}
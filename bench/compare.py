@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Compares two benchmark runs written with --json.
+
+Usage: compare.py [--threshold PCT] [--noise K] [--filter REGEX]
+                  [--metric NAME] baseline.json current.json
+
+For every benchmark in both runs, prints the baseline and current
+medians and the change between them. A benchmark has regressed if its
+median got slower by more than PCT percent (default 5) and by more
+than K (default 3) times the noise. The noise is the larger of the two
+runs' median absolute deviations, relative to their medians, so a noisy
+benchmark needs a bigger change before it counts. Only benchmarks whose
+name matches REGEX (default: all) are tracked.
+
+With --metric, a hardware counter recorded by --counters (cycles,
+instructions, l1d_misses, llc_misses, branch_misses or dtlb_misses) is
+compared per call instead of the time. Counters are recorded once per
+benchmark, so only the threshold applies to them.
+
+Exits with status 1 if any tracked benchmark regressed.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+
+def median(values):
+    values = sorted(values)
+    mid = len(values) // 2
+    if len(values) % 2:
+        return values[mid]
+    return (values[mid - 1] + values[mid]) / 2
+
+
+def relative_noise(samples):
+    """Median absolute deviation, as a fraction of the median."""
+    m = median(samples)
+    if m <= 0:
+        return 0.0
+    return median([abs(s - m) for s in samples]) / m
+
+
+def samples(benchmark, metric):
+    """The benchmark's values of metric, or [] if it wasn't recorded."""
+    if metric == "ns":
+        return benchmark["samples_ns"]
+    counters = benchmark.get("counters", {})
+    return [counters[metric]] if metric in counters else []
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return {b["name"]: b for b in data["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="percent slowdown that counts as a regression")
+    parser.add_argument("--noise", type=float, default=3.0,
+                        help="multiple of the noise a slowdown must exceed")
+    parser.add_argument("--filter", default="",
+                        help="only track benchmarks matching this regex")
+    parser.add_argument("--metric", default="ns",
+                        help="a recorded counter to compare instead of ns")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    tracked = re.compile(args.filter)
+
+    regressions = []
+    print("%-44s %12s %12s %9s %7s" %
+          ("benchmark", "baseline " + args.metric,
+           "current " + args.metric, "change", "noise"))
+    for name in sorted(set(baseline) & set(current)):
+        if not tracked.search(name):
+            continue
+        old = samples(baseline[name], args.metric)
+        new = samples(current[name], args.metric)
+        if not old or not new:
+            print("%-44s no %s recorded" % (name, args.metric))
+            continue
+        old_median = median(old)
+        new_median = median(new)
+        if old_median <= 0:
+            continue
+        change = new_median / old_median - 1
+        noise = max(relative_noise(old), relative_noise(new))
+        regressed = (change * 100 > args.threshold and
+                     change > args.noise * noise)
+        if regressed:
+            regressions.append(name)
+        print("%-44s %12.1f %12.1f %+8.1f%% %6.1f%%%s" %
+              (name, old_median, new_median, change * 100, noise * 100,
+               "  REGRESSED" if regressed else ""))
+
+    missing = sorted(n for n in set(baseline) - set(current)
+                     if tracked.search(n))
+    for name in missing:
+        print("%-44s missing from %s" % (name, args.current))
+
+    if regressions:
+        print("\n%d of the tracked benchmarks regressed by more than %g%%"
+              % (len(regressions), args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
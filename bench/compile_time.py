@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Measures what small_vector costs to compile.
+
+Usage: compile_time.py [--cxx CXX] [--std STD] [--repetitions R]
+                       [--units U]
+
+Run from the directory holding small_vector.h.
+
+The first table times a translation unit that instantiates small_vector
+for 1, 10, 50 and 200 different small sizes, each with push_back, copy
+and iteration, next to one that does the same with std::vector. The
+"front end" column parses and instantiates only (-fsyntax-only), and
+"full" compiles with -O2; both include the cost of the headers.
+
+The second table compiles U (default 10) translation units that all use
+the common specializations, once as usual and once with
+SMALLVECTOR_EXTERN_TEMPLATES, where they instantiate nothing and
+small_vector_instantiations.cpp is compiled once instead, at -O0 and
+-O2. It gives the time for the units, the time for the instantiations
+(paid once however many units there are) and the total object size.
+With optimization, the compiler still instantiates what it inlines, so
+most of the saving is in unoptimized builds.
+
+Times are the median of R (default 3) runs, in ms.
+"""
+
+import argparse
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+USE = """
+long long use_%(i)d() {
+  %(type)s v;
+  for (int i=0; i<%(n)d; ++i) v.push_back(%(value)s);
+  %(type)s copy(v);
+  long long sum = 0;
+  for (%(type)s::const_iterator i = copy.begin(); i != copy.end(); ++i) {
+    sum += (long long)*i;
+  }
+  return sum;
+}
+"""
+
+# One line per common specialization, as in small_vector.h
+COMMON = [("char", 16, "'a'"), ("char", 32, "'a'"), ("int", 4, "i"),
+          ("int", 8, "i"), ("int", 16, "i"), ("unsigned", 4, "i"),
+          ("unsigned", 8, "i"), ("unsigned", 16, "i"), ("double", 4, "i"),
+          ("double", 8, "i"), ("void*", 4, "0"), ("void*", 8, "0")]
+
+
+def timed(command, repetitions):
+    """Median ms that command took to run."""
+    times = []
+    for _ in range(repetitions):
+        start = time.perf_counter()
+        subprocess.run(command, check=True)
+        times.append((time.perf_counter() - start) * 1e3)
+    return statistics.median(times)
+
+
+def instantiations_source(count, std_vector):
+    lines = ["#include <vector>", '#include "small_vector.h"']
+    for i in range(count):
+        if std_vector:
+            # A distinct element type per instantiation, as small_vector
+            # gets from its distinct small sizes
+            lines.append("enum e_%d { e_%d_value };" % (i, i))
+            vector = "std::vector<e_%d>" % i
+            value = "e_%d_value" % i
+        else:
+            vector = "small_vector<int, %d>" % (i + 1)
+            value = "i"
+        lines.append(USE % {"i": i, "type": vector, "n": 2 * i + 2,
+                            "value": value})
+    return "\n".join(lines) + "\n"
+
+
+def common_source(unit):
+    lines = ['#include "small_vector.h"']
+    for k, (t, n, value) in enumerate(COMMON):
+        lines.append(USE % {"i": unit * len(COMMON) + k,
+                            "type": "small_vector<%s, %d>" % (t, n),
+                            "n": 2 * n, "value": value})
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.splitlines()[0])
+    parser.add_argument("--cxx", default=os.environ.get("CXX", "c++"))
+    parser.add_argument("--std", default="c++17")
+    parser.add_argument("--repetitions", type=int, default=3)
+    parser.add_argument("--units", type=int, default=10)
+    args = parser.parse_args()
+
+    here = os.getcwd()
+    if not os.path.exists(os.path.join(here, "small_vector.h")):
+        print("Run from the directory holding small_vector.h",
+              file=sys.stderr)
+        return 2
+    flags = [args.cxx, "-std=" + args.std, "-I", here]
+    work = tempfile.mkdtemp(prefix="small_vector_compile_time.")
+    try:
+        print("%-36s %12s %12s" % ("instantiations", "front end ms",
+                                   "full ms"))
+        for count in (1, 10, 50, 200):
+            for std_vector in (False, True):
+                path = os.path.join(work, "instantiations.cpp")
+                with open(path, "w") as f:
+                    f.write(instantiations_source(count, std_vector))
+                front = timed(flags + ["-fsyntax-only", path],
+                              args.repetitions)
+                full = timed(flags + ["-O2", "-c", path, "-o",
+                                      os.path.join(work, "i.o")],
+                             args.repetitions)
+                print("%-36s %12.0f %12.0f" %
+                      ("%d x %s" % (count, "std::vector" if std_vector
+                                    else "small_vector"), front, full))
+                sys.stdout.flush()
+
+        sources = []
+        for unit in range(args.units):
+            path = os.path.join(work, "unit_%d.cpp" % unit)
+            with open(path, "w") as f:
+                f.write(common_source(unit))
+            sources.append(path)
+
+        instantiations = os.path.join(here, "small_vector_instantiations.cpp")
+        print("\n%-36s %12s %12s %12s" % ("%d units" % args.units,
+                                          "units ms", "once ms",
+                                          "object KiB"))
+        for opt in ("-O0", "-O2"):
+            for extern in (False, True):
+                defines = ["-DSMALLVECTOR_EXTERN_TEMPLATES"] if extern else []
+                obj = os.path.join(work, "unit.o")
+                units = 0.0
+                size = 0
+                for source in sources:
+                    units += timed(flags + defines + [opt, "-c", source, "-o",
+                                                      obj], args.repetitions)
+                    size += os.path.getsize(obj)
+                once = 0.0
+                if extern:
+                    once = timed(flags + [opt, "-c", instantiations, "-o", obj],
+                                 args.repetitions)
+                    size += os.path.getsize(obj)
+                print("%-36s %12.0f %12.0f %12.0f" %
+                      ("%s %s" % (opt, "extern templates" if extern
+                                  else "instantiated per unit"),
+                       units, once, size / 1024.0))
+                sys.stdout.flush()
+    finally:
+        shutil.rmtree(work)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
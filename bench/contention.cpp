@@ -0,0 +1,161 @@
+// Measures how spill-heavy work scales across threads. Every thread
+// creates, fills, sums and destroys short-lived small_vector<int, 8>s,
+// a given fraction of which spill to the heap (to 32 elements), with
+// each allocator the library offers:
+//
+//   std::allocator         straight to malloc
+//   spill_cache_allocator  per-thread cache of spill buffers
+//   arena_allocator        per-thread monotonic_arena, released every
+//                          256 vectors as if at the end of a request
+//
+// Each cell is the throughput per thread, in millions of vectors per
+// second; with linear scaling, a row stays flat as threads are added.
+// The last column is the per-thread throughput at the most threads
+// relative to one thread.
+//
+// Usage: contention [max threads] [vectors per thread]
+//
+// Threads double from 1 up to max threads, which defaults to the number
+// of cores.
+
+#include "small_vector.h"
+#include "arena_allocator.h"
+#include "spill_cache_allocator.h"
+#include "bench.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+  const std::size_t SmallSize = 8;
+  const std::size_t SpillSize = 32;
+  const unsigned VectorsPerRequest = 256;
+
+  using bench::lcg;
+
+  // Sizes within the small storage, or a spill with probability
+  // spill_percent / 100
+  unsigned pick_size(lcg& rng, unsigned spill_percent) {
+    const unsigned r = rng.next();
+    return r % 100 < spill_percent ? SpillSize : 1 + r % SmallSize;
+  }
+
+  template <class Vector>
+  long long fill_and_sum(Vector& v, unsigned n) {
+    for (unsigned i=0; i<n; ++i) v.push_back(static_cast<int>(i));
+    long long sum = 0;
+    for (unsigned i=0; i<n; ++i) sum += v[i];
+    return sum;
+  }
+
+  struct default_work {
+    long long operator()(lcg& rng, unsigned spill_percent) {
+      small_vector<int, SmallSize> v;
+      return fill_and_sum(v, pick_size(rng, spill_percent));
+    }
+  };
+
+  struct spill_cache_work {
+    long long operator()(lcg& rng, unsigned spill_percent) {
+      small_vector<int, SmallSize,
+                   spill_cache_allocator<int, SmallSize> > v;
+      return fill_and_sum(v, pick_size(rng, spill_percent));
+    }
+  };
+
+  struct arena_work {
+    arena_work() : count(0) {}
+    long long operator()(lcg& rng, unsigned spill_percent) {
+      long long sum;
+      {
+        small_vector<int, SmallSize, arena_allocator<int> > v(
+          (arena_allocator<int>(arena)));
+        sum = fill_and_sum(v, pick_size(rng, spill_percent));
+      }
+      if (++count == VectorsPerRequest) {
+        arena.release();
+        count = 0;
+      }
+      return sum;
+    }
+    monotonic_arena arena;
+    unsigned count;
+  };
+
+  // Millions of vectors per second per thread, with threads threads
+  // each doing vectors vectors
+  template <class Work>
+  double run(unsigned threads, std::size_t vectors, unsigned spill_percent) {
+    std::atomic<unsigned> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> pool;
+    for (unsigned t=0; t<threads; ++t) {
+      pool.push_back(std::thread([&, t] {
+        Work work;
+        lcg rng(t + 1);
+        ++ready;
+        while (!go.load()) {
+          std::this_thread::yield();
+        }
+        long long sum = 0;
+        for (std::size_t i=0; i<vectors; ++i) sum += work(rng, spill_percent);
+        bench::do_not_optimize(sum);
+      }));
+    }
+    while (ready.load() != threads) {
+      std::this_thread::yield();
+    }
+    const double start = bench::now();
+    go.store(true);
+    for (unsigned t=0; t<threads; ++t) pool[t].join();
+    return vectors / (bench::now() - start) / 1e6;
+  }
+
+  template <class Work>
+  void row(const char* name, unsigned spill_percent,
+           const std::vector<unsigned>& thread_counts, std::size_t vectors) {
+    std::printf("%-22s %5u%%", name, spill_percent);
+    double first = 0, last = 0;
+    for (std::size_t i=0; i<thread_counts.size(); ++i) {
+      last = run<Work>(thread_counts[i], vectors, spill_percent);
+      if (i == 0) first = last;
+      std::printf(" %8.2f", last);
+      std::fflush(stdout);
+    }
+    std::printf(" %8.2f\n", last / first);
+  }
+}
+
+int main(int argc, char** argv) {
+  unsigned max_threads = std::thread::hardware_concurrency();
+  if (argc > 1) max_threads = std::strtoul(argv[1], NULL, 0);
+  if (max_threads == 0) max_threads = 1;
+  const std::size_t vectors = argc > 2 ? std::strtoul(argv[2], NULL, 0)
+                                       : 500000;
+
+  std::vector<unsigned> thread_counts;
+  for (unsigned t=1; t<max_threads; t*=2) thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  std::printf("M vectors/s per thread, small_vector<int, %zu>, "
+              "spills to %zu\n", SmallSize, SpillSize);
+  std::printf("%-22s %6s", "allocator", "spill");
+  for (std::size_t i=0; i<thread_counts.size(); ++i) {
+    std::printf(" %5u thr", thread_counts[i]);
+  }
+  std::printf(" %8s\n", "scaling");
+
+  const unsigned spill_percents[] = { 0, 10, 50, 100 };
+  for (int s=0; s<4; ++s) {
+    row<default_work>("std::allocator", spill_percents[s],
+                      thread_counts, vectors);
+    row<spill_cache_work>("spill_cache_allocator", spill_percents[s],
+                          thread_counts, vectors);
+    row<arena_work>("arena_allocator", spill_percents[s],
+                    thread_counts, vectors);
+  }
+  return 0;
+}
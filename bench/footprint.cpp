@@ -0,0 +1,139 @@
+// Measures the memory footprint of a population of containers: sizeof
+// the container, the heap bytes it allocates, and the growth in resident
+// set size, per container. Rows compare std::vector with small_vector
+// at several small sizes, for a few element types and size distributions:
+//
+//   constant   every container holds 4 elements
+//   geometric  sizes 0, 1, 2, ... with mean 4 and a long tail
+//   bimodal    90% hold 2 elements, 10% hold 40
+//
+// "vs vector" is the RSS per container relative to std::vector's; below
+// 1.00 the inline storage saves memory, above it costs memory.
+//
+// Usage: footprint [containers]
+//
+// Each configuration runs in its own child process so that the RSS
+// reported belongs to that configuration alone.
+
+#include "small_vector.h"
+#include "bench.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+  // Resident set size right now, in bytes
+  long long current_rss() {
+    long pages = 0, resident = 0;
+    FILE* f = std::fopen("/proc/self/statm", "r");
+    if (!f) return -1;
+    if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = -1;
+    std::fclose(f);
+    return static_cast<long long>(resident) * sysconf(_SC_PAGESIZE);
+  }
+
+  using bench::counting_allocator;
+  using bench::heap_bytes;
+  using bench::lcg;
+
+  template <std::size_t Bytes>
+  struct pod {
+    char bytes[Bytes];
+  };
+
+  enum distribution { constant, geometric, bimodal };
+  const char* const distribution_names[] = {
+    "constant", "geometric", "bimodal"
+  };
+
+  unsigned pick_size(distribution d, lcg& rng) {
+    switch (d) {
+    case constant:
+      return 4;
+    case geometric:
+      // P(k) = p (1 - p)^k, with mean (1 - p) / p = 4
+      return static_cast<unsigned>(std::log(1 - rng.uniform()) /
+                                   std::log(1 - 0.2));
+    case bimodal:
+      return rng.next() % 10 ? 2 : 40;
+    }
+    return 0;
+  }
+
+  // Fills count containers in a child process, prints a row, and
+  // returns how much the RSS grew
+  template <class Container>
+  long long measure(const char* name, distribution d, std::size_t count,
+                    long long vector_rss) {
+    std::fflush(stdout);
+    int fds[2];
+    if (pipe(fds) != 0) {
+      std::perror("pipe");
+      std::exit(1);
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      lcg rng(1);
+      const long long rss_before = current_rss();
+      std::vector<Container> population(count);
+      for (std::size_t c=0; c<count; ++c) {
+        const unsigned n = pick_size(d, rng);
+        for (unsigned i=0; i<n; ++i) {
+          population[c].push_back(typename Container::value_type());
+        }
+      }
+      long long rss = current_rss() - rss_before;
+      std::printf("  %-24s %8zu %10.1f %10.1f %10.1f",
+                  name, sizeof(Container), double(heap_bytes()) / count,
+                  double(sizeof(Container)) + double(heap_bytes()) / count,
+                  double(rss) / count);
+      if (vector_rss > 0) {
+        std::printf(" %10.2f", double(rss) / vector_rss);
+      }
+      std::printf("\n");
+      std::fflush(stdout);
+      if (write(fds[1], &rss, sizeof(rss)) != sizeof(rss)) rss = -1;
+      std::_Exit(0);
+    }
+    close(fds[1]);
+    long long rss = -1;
+    if (read(fds[0], &rss, sizeof(rss)) != sizeof(rss)) rss = -1;
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    return rss;
+  }
+
+  template <class T>
+  void run(const char* type_name, std::size_t count) {
+    for (int d=constant; d<=bimodal; ++d) {
+      std::printf("T = %s (%zu bytes), %s sizes\n", type_name, sizeof(T),
+                  distribution_names[d]);
+      const long long vector_rss =
+        measure<std::vector<T, counting_allocator<T> > >(
+          "std::vector", distribution(d), count, 0);
+      measure<small_vector<T, 1, counting_allocator<T> > >(
+        "small_vector<T, 1>", distribution(d), count, vector_rss);
+      measure<small_vector<T, 4, counting_allocator<T> > >(
+        "small_vector<T, 4>", distribution(d), count, vector_rss);
+      measure<small_vector<T, 16, counting_allocator<T> > >(
+        "small_vector<T, 16>", distribution(d), count, vector_rss);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  const std::size_t count = argc > 1 ? std::strtoul(argv[1], NULL, 0)
+                                     : 1000000;
+  std::printf("%zu containers; bytes per container\n", count);
+  std::printf("  %-24s %8s %10s %10s %10s %10s\n", "container", "sizeof",
+              "heap", "total", "rss", "vs vector");
+  run<int>("int", count);
+  run<pod<16> >("pod<16>", count);
+  run<pod<64> >("pod<64>", count);
+  return 0;
+}
@@ -0,0 +1,159 @@
+// Times single operations, to show the tail latency that throughput
+// numbers average away: each push_back or construction is timed on its
+// own, and the rows give percentiles of those times in ns.
+//
+//   append     one container taking ops push_backs in a row, so the
+//              tail is the reallocations and their relocation cost
+//   spill      many fresh containers each filled one past N; the inline
+//              pushes and the spilling push are reported separately
+//   construct  the (n, value) constructor, below and above N
+//
+// Usage: latency [--histogram] [ops]
+//
+// The timestamps are the TSC on x86 (unserialized, so single-digit ns
+// are noise), and the timer's own overhead is printed first.
+
+#include "small_vector.h"
+#include "mmap_allocator.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+  bool histograms = false;
+
+  void print_header() {
+    std::printf("%-12s %-40s %9s %9s %9s %9s %9s %9s\n", "scenario",
+                "container", "p50", "p90", "p99", "p99.9", "max", "samples");
+  }
+
+  void print_row(const char* scenario, const char* name,
+                 bench::latencies& l) {
+    std::printf("%-12s %-40s %9.0f %9.0f %9.0f %9.0f %9.0f %9zu\n",
+                scenario, name, l.percentile(0.5), l.percentile(0.9),
+                l.percentile(0.99), l.percentile(0.999), l.max(), l.size());
+    if (histograms) {
+      l.print_histogram(stdout);
+    }
+    std::fflush(stdout);
+  }
+
+  template <class T> T make(std::size_t i);
+  template <> int make<int>(std::size_t i) {
+    return static_cast<int>(i);
+  }
+  template <> std::string make<std::string>(std::size_t i) {
+    return std::string("element") + char('a' + i % 26);
+  }
+
+  template <class Vector>
+  void append(const char* name, std::size_t ops) {
+    typedef typename Vector::value_type value_type;
+    const value_type x = make<value_type>(1);
+    bench::latencies l;
+    l.reserve(ops);
+    Vector v;
+    for (std::size_t i=0; i<ops; ++i) {
+      const unsigned long long start = bench::ticks();
+      v.push_back(x);
+      l.add(bench::ticks() - start);
+    }
+    bench::do_not_optimize(v);
+    print_row("append", name, l);
+  }
+
+  // Vector holds N inline elements; std::vector is filled the same way
+  template <class Vector, std::size_t N>
+  void spill(const char* name, std::size_t ops) {
+    const std::size_t vectors = ops / (N + 1);
+    bench::latencies inline_pushes, spilling_pushes;
+    inline_pushes.reserve(vectors * N);
+    spilling_pushes.reserve(vectors);
+    for (std::size_t c=0; c<vectors; ++c) {
+      Vector v;
+      for (std::size_t i=0; i<=N; ++i) {
+        const unsigned long long start = bench::ticks();
+        v.push_back(static_cast<int>(i));
+        const unsigned long long duration = bench::ticks() - start;
+        if (i < N) {
+          inline_pushes.add(duration);
+        } else {
+          spilling_pushes.add(duration);
+        }
+      }
+      bench::do_not_optimize(v);
+    }
+    char row[64];
+    std::snprintf(row, sizeof(row), "%s, pushes 1-%zu", name, N);
+    print_row("spill", row, inline_pushes);
+    std::snprintf(row, sizeof(row), "%s, push %zu", name, N + 1);
+    print_row("spill", row, spilling_pushes);
+  }
+
+  template <class Vector>
+  void construct(const char* name, std::size_t n, std::size_t ops) {
+    bench::latencies l;
+    l.reserve(ops);
+    for (std::size_t c=0; c<ops; ++c) {
+      void* storage[(sizeof(Vector) + sizeof(void*) - 1) / sizeof(void*)];
+      const unsigned long long start = bench::ticks();
+      Vector* v = new (storage) Vector(n, 7);
+      l.add(bench::ticks() - start);
+      bench::do_not_optimize(*v);
+      v->~Vector();
+    }
+    char row[64];
+    std::snprintf(row, sizeof(row), "%s, n = %zu", name, n);
+    print_row("construct", row, l);
+  }
+}
+
+int main(int argc, char** argv) {
+  std::size_t ops = 1000000;
+  for (int i=1; i<argc; ++i) {
+    if (!std::strcmp(argv[i], "--histogram")) {
+      histograms = true;
+    } else if (argv[i][0] != '-') {
+      ops = std::strtoul(argv[i], NULL, 0);
+    } else {
+      std::fprintf(stderr, "Usage: %s [--histogram] [ops]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  {
+    bench::latencies overhead;
+    for (int i=0; i<100000; ++i) {
+      const unsigned long long start = bench::ticks();
+      overhead.add(bench::ticks() - start);
+    }
+    std::printf("%.2f ns per tick; timer overhead p50 %.0f ns\n\n",
+                bench::ns_per_tick(), overhead.percentile(0.5));
+  }
+
+  print_header();
+  append<small_vector<int, 16> >("small_vector<int, 16>", ops);
+  append<std::vector<int> >("std::vector<int>", ops);
+  append<small_vector<int, 16, mmap_allocator<int, 64 * 1024> > >(
+    "small_vector<int, 16, mmap_allocator>", ops);
+  append<small_vector<std::string, 16> >("small_vector<string, 16>", ops);
+  append<std::vector<std::string> >("std::vector<string>", ops);
+
+  spill<small_vector<int, 4>, 4>("small_vector<int, 4>", ops);
+  spill<std::vector<int>, 4>("std::vector<int>", ops);
+  spill<small_vector<int, 16>, 16>("small_vector<int, 16>", ops);
+  spill<std::vector<int>, 16>("std::vector<int>", ops);
+  spill<small_vector<int, 64>, 64>("small_vector<int, 64>", ops);
+  spill<std::vector<int>, 64>("std::vector<int>", ops);
+
+  construct<small_vector<int, 16> >("small_vector<int, 16>", 8, ops);
+  construct<small_vector<int, 16> >("small_vector<int, 16>", 32, ops);
+  construct<std::vector<int> >("std::vector<int>", 8, ops);
+  construct<std::vector<int> >("std::vector<int>", 32, ops);
+  return 0;
+}
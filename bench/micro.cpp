@@ -0,0 +1,153 @@
+// Microbenchmarks of the basic operations, comparing small_vector with
+// std::vector and, when its headers are installed,
+// boost::container::small_vector.
+//
+// Each row is one operation on containers of size elements, for
+// element type T and small size N; the columns are ns per container
+// (construct, fill, destroy) or per pass for iterate.
+//
+// Usage: micro [--min-time seconds] [--repetitions n] [--json file]
+//              [--counters] [filter]
+//
+// filter picks the rows whose "op/T/N/size" name contains it, e.g.
+// "push_back/int/". With --json, every measurement is also written to
+// file as "op/T/N/size/container"; see bench/compare.py. With
+// --counters, each row is followed by the hardware events per
+// container, or per pass for iterate.
+
+#include "small_vector.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if !defined(BENCH_NO_BOOST) && defined(__has_include)
+#if __has_include(<boost/container/small_vector.hpp>)
+#include <boost/container/small_vector.hpp>
+#define BENCH_HAVE_BOOST 1
+#endif
+#endif
+
+namespace {
+  struct pod32 {
+    int values[8];
+  };
+
+  template <class T> T make(std::size_t i);
+  template <> int make<int>(std::size_t i) {
+    return static_cast<int>(i);
+  }
+  template <> pod32 make<pod32>(std::size_t i) {
+    pod32 p;
+    for (int k=0; k<8; ++k) p.values[k] = static_cast<int>(i) + k;
+    return p;
+  }
+  // Short enough to stay in the string's own small buffer
+  template <> std::string make<std::string>(std::size_t i) {
+    return std::string("element") + char('a' + i % 26);
+  }
+
+  long long weight(int x) { return x; }
+  long long weight(const pod32& p) { return p.values[0]; }
+  long long weight(const std::string& s) { return s.size(); }
+
+  enum op { push_back, copy, range, iterate };
+  const char* const op_names[] = { "push_back", "copy", "range", "iterate" };
+
+  // ns for one op on a Vector of values.size() elements
+  template <class Vector>
+  double time_op(op o, const std::vector<typename Vector::value_type>& values,
+                 const std::string& name, bench::recorder& rec) {
+    const std::size_t n = values.size();
+    const Vector src(values.begin(), values.end());
+    switch (o) {
+    case push_back:
+      return rec.run(name, [&] {
+        Vector v;
+        for (std::size_t i=0; i<n; ++i) v.push_back(values[i]);
+        bench::do_not_optimize(v);
+      });
+    case copy:
+      return rec.run(name, [&] {
+        Vector v(src);
+        bench::do_not_optimize(v);
+      });
+    case range:
+      return rec.run(name, [&] {
+        Vector v(values.begin(), values.end());
+        bench::do_not_optimize(v);
+      });
+    case iterate:
+      return rec.run(name, [&] {
+        long long sum = 0;
+        for (typename Vector::const_iterator i = src.begin();
+             i != src.end(); ++i) {
+          sum += weight(*i);
+        }
+        bench::do_not_optimize(sum);
+      });
+    }
+    return 0;
+  }
+
+  template <class T, std::size_t N>
+  void run(const char* type_name, const bench::options& opts,
+           bench::recorder& rec) {
+    // One size that stays small, and one that spills
+    const std::size_t sizes[] = { N / 2, N ? 4 * N : 4 };
+    for (int o=push_back; o<=iterate; ++o) {
+      for (std::size_t s = N ? 0 : 1; s<2; ++s) {
+        std::vector<T> values;
+        for (std::size_t i=0; i<sizes[s]; ++i) values.push_back(make<T>(i));
+
+        char name[128];
+        std::snprintf(name, sizeof(name), "%s/%s/%zu/%zu",
+                      op_names[o], type_name, N, sizes[s]);
+        if (!opts.selected(name)) continue;
+
+        const std::string prefix = std::string(name) + "/";
+        std::printf("%-28s", name);
+        std::printf(" %14.1f", time_op<small_vector<T, N> >(
+                      op(o), values, prefix + "small_vector", rec));
+        std::printf(" %14.1f", time_op<std::vector<T> >(
+                      op(o), values, prefix + "std::vector", rec));
+        std::size_t containers = 2;
+#ifdef BENCH_HAVE_BOOST
+        typedef boost::container::small_vector<T, N> boost_vector;
+        std::printf(" %14.1f", time_op<boost_vector>(
+                      op(o), values, prefix + "boost", rec));
+        ++containers;
+#endif
+        std::printf("\n");
+        rec.print_counters(stdout, containers);
+        std::fflush(stdout);
+      }
+    }
+  }
+
+  template <class T>
+  void run_all(const char* type_name, const bench::options& opts,
+               bench::recorder& rec) {
+    run<T, 0>(type_name, opts, rec);
+    run<T, 4>(type_name, opts, rec);
+    run<T, 16>(type_name, opts, rec);
+    run<T, 64>(type_name, opts, rec);
+  }
+}
+
+int main(int argc, char** argv) {
+  const bench::options opts(argc, argv);
+  bench::recorder rec(opts);
+  std::printf("%-28s %14s %14s", "op/T/N/size", "small_vector",
+              "std::vector");
+#ifdef BENCH_HAVE_BOOST
+  std::printf(" %14s", "boost");
+#endif
+  std::printf("\n");
+
+  run_all<int>("int", opts, rec);
+  run_all<pod32>("pod32", opts, rec);
+  run_all<std::string>("string", opts, rec);
+  return 0;
+}
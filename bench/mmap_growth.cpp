@@ -0,0 +1,83 @@
+// Compares growing a small_vector to a very large size with the default
+// allocate-copy-free loop against mmap_allocator's mremap path.
+//
+// Usage: mmap_growth [elements]
+//
+// Each configuration runs in its own child process so that the peak
+// RSS reported by the kernel belongs to that configuration alone.
+
+#include "small_vector.h"
+#include "mmap_allocator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+  double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  // Resident set size right now, in KiB
+  long current_rss_kb() {
+    long pages = 0, resident = 0;
+    FILE* f = std::fopen("/proc/self/statm", "r");
+    if (!f) return -1;
+    if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = -1;
+    std::fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+  }
+
+  template <class Vector>
+  void grow(const char* name, std::size_t n) {
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      double grow_time, shrink_time;
+      long grown_rss, shrunk_rss;
+      {
+        Vector vec;
+        const double start = now();
+        for (std::size_t i=0; i<n; ++i) vec.push_back(static_cast<int>(i));
+        grow_time = now() - start;
+        grown_rss = current_rss_kb();
+
+        // Unless n is a power of two, this gives back the unused tail
+        const double shrink_start = now();
+        vec.shrink_to_fit();
+        shrink_time = now() - shrink_start;
+        shrunk_rss = current_rss_kb();
+      }
+      std::printf("%-28s %10.1f %10.1f %12ld %12ld",
+                  name, grow_time * 1e3, shrink_time * 1e3,
+                  grown_rss, shrunk_rss);
+      std::fflush(stdout);
+      std::_Exit(0);
+    }
+
+    int status;
+    rusage usage;
+    wait4(pid, &status, 0, &usage);
+    std::printf(" %12ld\n", usage.ru_maxrss);
+  }
+}
+
+int main(int argc, char** argv) {
+  const std::size_t n = argc > 1 ? std::strtoul(argv[1], NULL, 0)
+                                 : 24u * 1024 * 1024;
+  std::printf("push_back of %zu ints (%zu MiB)\n",
+              n, n * sizeof(int) >> 20);
+  std::printf("%-28s %10s %10s %12s %12s %12s\n", "allocator",
+              "grow ms", "shrink ms", "rss KiB", "shrunk KiB", "peak KiB");
+
+  grow< small_vector<int, 16> >("std::allocator", n);
+  grow< small_vector<int, 16, mmap_allocator<int> > >("mmap_allocator", n);
+  grow< small_vector<int, 16, mmap_allocator<int, 1024 * 1024, true> > >(
+      "mmap_allocator (hugepages)", n);
+  return 0;
+}
@@ -0,0 +1,399 @@
+// Replays a trace recorded with SMALLVECTOR_TRACE (see
+// small_vector_trace.h) against other configurations, to pick one
+// offline from the shapes a real program produced.
+//
+// The trace is split by recorded small_vector<T, N> type, as (sizeof(T),
+// N). Each type's operations are re-executed, in order, with
+//
+//   std::vector
+//   small_vector at N = 2, 4, 8, 16 and 32, each with
+//     its own growth (doubling) and std::allocator
+//     growth by 1.5x (reserving whenever full before a push_back)
+//     spill_cache_allocator
+//
+// and each row gives the median time of the replays, the heap traffic
+// (bytes and calls to allocate), and the peak memory: the containers
+// themselves plus their heap buffers, at the worst point in the trace.
+// The row with the recorded N, if it is one of these, is marked *.
+//
+// The replay stands in a trivially copyable type of the next size up
+// from {1, 2, 4, 8, 16, 32, 64, 128} bytes for T, so it doesn't repeat
+// the cost of copying the real elements. Types over 128 bytes are
+// skipped.
+//
+// Usage: replay [--repetitions n] [--top k] trace
+
+#include "small_vector.h"
+#include "spill_cache_allocator.h"
+#include "small_vector_trace.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+  // One operation, on the slot the vector occupies while it's alive
+  struct event {
+    unsigned char op;
+    unsigned slot;
+    unsigned size;
+  };
+
+  // The operations on one recorded type
+  struct trace_group {
+    trace_group() : vectors(0), slots(0), max_size(0) {}
+    std::vector<event> events;
+    std::size_t vectors;
+    std::size_t slots;          // Most vectors alive at once
+    std::size_t max_size;
+  };
+
+  typedef std::pair<unsigned, unsigned> type_key;   // sizeof(T), N
+
+  // Reads path into groups. Returns false, having said why, if it can't.
+  bool load(const char* path, std::map<type_key, trace_group>& groups,
+            std::size_t& skipped) {
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) {
+      std::perror(path);
+      return false;
+    }
+    small_vector_trace_header header;
+    if (std::fread(&header, sizeof(header), 1, f) != 1 ||
+        std::memcmp(header.magic, "SVTRACE", 8) != 0 ||
+        header.version != 1 ||
+        header.record_size != sizeof(small_vector_trace_record)) {
+      std::fprintf(stderr, "%s: not a version 1 small_vector trace\n", path);
+      std::fclose(f);
+      return false;
+    }
+
+    // Slots are handed out per type, and reused once a vector is gone
+    struct slot_state {
+      std::unordered_map<unsigned, unsigned> live;
+      std::vector<unsigned> free;
+    };
+    std::map<type_key, slot_state> slots;
+
+    skipped = 0;
+    small_vector_trace_record r;
+    while (std::fread(&r, sizeof(r), 1, f) == 1) {
+      const type_key key(r.element_size, r.small_size);
+      trace_group& g = groups[key];
+      slot_state& s = slots[key];
+      event e;
+      e.op = r.op;
+      e.size = r.size;
+      if (r.op == small_vector_operation::construct ||
+          r.op == small_vector_operation::copy) {
+        if (s.live.count(r.vector)) {
+          ++skipped;
+          continue;
+        }
+        if (s.free.empty()) {
+          s.free.push_back(g.slots++);
+        }
+        e.slot = s.free.back();
+        s.free.pop_back();
+        s.live[r.vector] = e.slot;
+        ++g.vectors;
+      } else {
+        // Vectors whose construction isn't in the trace are left out
+        std::unordered_map<unsigned, unsigned>::iterator i =
+          s.live.find(r.vector);
+        if (i == s.live.end()) {
+          ++skipped;
+          continue;
+        }
+        e.slot = i->second;
+        if (r.op == small_vector_operation::destroy) {
+          s.free.push_back(e.slot);
+          s.live.erase(i);
+        }
+      }
+      if (r.op != small_vector_operation::reserve) {
+        g.max_size = std::max<std::size_t>(g.max_size, r.size);
+      }
+      g.events.push_back(e);
+    }
+    std::fclose(f);
+    return true;
+  }
+
+  // Heap use through tracking_allocator
+  struct heap_counts {
+    unsigned long long allocations;
+    unsigned long long bytes;       // Allocated in total
+    long long live;
+  };
+  heap_counts heap;
+
+  // Counts what Base allocates
+  template <class T, class Base>
+  struct tracking_allocator : Base {
+    typedef T value_type;
+    template <class U>
+    struct rebind {
+      typedef tracking_allocator<U, typename std::allocator_traits<Base>::
+                                      template rebind_alloc<U> > other;
+    };
+
+    tracking_allocator() {}
+    template <class U, class B>
+    tracking_allocator(const tracking_allocator<U, B>&) {}
+
+    T* allocate(std::size_t n) {
+      ++heap.allocations;
+      heap.bytes += n * sizeof(T);
+      heap.live += n * sizeof(T);
+      return Base::allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) {
+      heap.live -= n * sizeof(T);
+      Base::deallocate(p, n);
+    }
+  };
+
+  template <std::size_t Width>
+  struct blob {
+    unsigned char bytes[Width];
+  };
+
+  template <class T, class A, class InputIterator>
+  void append(std::vector<T, A>& v, InputIterator first,
+              InputIterator last) {
+    v.insert(v.end(), first, last);
+  }
+  template <class T, std::size_t N, class A, class InputIterator>
+  void append(small_vector<T, N, A>& v, InputIterator first,
+              InputIterator last) {
+    v.append(first, last);
+  }
+
+  struct replay_result {
+    double ms;
+    unsigned long long allocations;
+    unsigned long long heap_bytes;
+    long long peak_bytes;
+  };
+
+  // Runs g's events once on Vectors
+  template <class Vector>
+  replay_result replay_once(const trace_group& g, bool grow_by_half) {
+    typedef typename Vector::value_type value_type;
+    const std::vector<value_type> source(g.max_size + 1, value_type());
+    struct alignas(Vector) slot {
+      unsigned char bytes[sizeof(Vector)];
+    };
+    std::vector<slot> slots(g.slots);
+    std::vector<bool> live(g.slots);
+    long long live_vectors = 0;
+    long long peak = 0;
+    std::memset(&heap, 0, sizeof(heap));
+
+    const double start = bench::now();
+    for (std::vector<event>::const_iterator e = g.events.begin();
+         e != g.events.end(); ++e) {
+      Vector* v = reinterpret_cast<Vector*>(&slots[e->slot]);
+      switch (e->op) {
+      case small_vector_operation::construct:
+      case small_vector_operation::copy:
+        new (v) Vector(source.begin(), source.begin() + e->size);
+        live[e->slot] = true;
+        ++live_vectors;
+        break;
+      case small_vector_operation::push_back:
+        if (grow_by_half && v->size() == v->capacity()) {
+          v->reserve(v->capacity() + v->capacity() / 2 + 1);
+        }
+        v->push_back(source[0]);
+        break;
+      case small_vector_operation::append:
+        if (e->size > v->size()) {
+          append(*v, source.begin(), source.begin() + (e->size - v->size()));
+        }
+        break;
+      case small_vector_operation::insert:
+        // The position isn't recorded, so this is the costliest one
+        v->insert(v->begin(), source[0]);
+        break;
+      case small_vector_operation::erase:
+        // Nor here; this is the cheapest
+        if (e->size < v->size()) {
+          v->erase(v->begin() + e->size, v->end());
+        }
+        break;
+      case small_vector_operation::reserve:
+        v->reserve(e->size);
+        break;
+      case small_vector_operation::shrink:
+        v->shrink_to_fit();
+        break;
+      case small_vector_operation::clear:
+        v->clear();
+        break;
+      case small_vector_operation::destroy:
+        v->~Vector();
+        live[e->slot] = false;
+        --live_vectors;
+        break;
+      }
+      peak = std::max<long long>(
+        peak, live_vectors * sizeof(Vector) + heap.live);
+    }
+    replay_result r;
+    r.ms = (bench::now() - start) * 1e3;
+    r.allocations = heap.allocations;
+    r.heap_bytes = heap.bytes;
+    r.peak_bytes = peak;
+
+    // Whatever the trace left alive
+    for (std::size_t s=0; s<slots.size(); ++s) {
+      if (live[s]) {
+        reinterpret_cast<Vector*>(&slots[s])->~Vector();
+      }
+    }
+    return r;
+  }
+
+  int repetitions = 3;
+
+  template <class Vector>
+  void row(const char* name, const trace_group& g, bool grow_by_half,
+           bool recorded) {
+    replay_result r = replay_once<Vector>(g, grow_by_half);
+    std::vector<double> times(1, r.ms);
+    for (int i=1; i<repetitions; ++i) {
+      times.push_back(replay_once<Vector>(g, grow_by_half).ms);
+    }
+    std::printf("  %-32s %10.1f %12.0f %12llu %10.0f\n",
+                (std::string(name) + (recorded ? " *" : "")).c_str(),
+                bench::median(times), r.heap_bytes / 1024.0,
+                r.allocations, r.peak_bytes / 1024.0);
+    std::fflush(stdout);
+  }
+
+  template <class T, std::size_t N>
+  void small_rows(const trace_group& g, unsigned recorded_n) {
+    typedef small_vector<T, N, tracking_allocator<T, std::allocator<T> > >
+      plain;
+    typedef small_vector<T, N,
+                         tracking_allocator<T, spill_cache_allocator<T, N> > >
+      cached;
+    char name[64];
+    std::snprintf(name, sizeof(name), "N = %zu", N);
+    row<plain>(name, g, false, recorded_n == N);
+    std::snprintf(name, sizeof(name), "N = %zu, 1.5x growth", N);
+    row<plain>(name, g, true, false);
+    std::snprintf(name, sizeof(name), "N = %zu, spill_cache_allocator", N);
+    row<cached>(name, g, false, false);
+  }
+
+  template <std::size_t Width>
+  void replay_all(const trace_group& g, unsigned recorded_n) {
+    typedef blob<Width> T;
+    row<std::vector<T, tracking_allocator<T, std::allocator<T> > > >(
+      "std::vector", g, false, false);
+    small_rows<T, 2>(g, recorded_n);
+    small_rows<T, 4>(g, recorded_n);
+    small_rows<T, 8>(g, recorded_n);
+    small_rows<T, 16>(g, recorded_n);
+    small_rows<T, 32>(g, recorded_n);
+  }
+
+  // The stand-in width for element_size, or 0 if there isn't one
+  std::size_t width_for(std::size_t element_size) {
+    for (std::size_t w=1; w<=128; w*=2) {
+      if (element_size <= w) {
+        return w;
+      }
+    }
+    return 0;
+  }
+
+  void replay_group(const type_key& key, const trace_group& g) {
+    const std::size_t width = width_for(key.first);
+    std::printf("sizeof(T) = %u, N = %u: %zu vectors, %zu operations, "
+                "largest %zu", key.first, key.second, g.vectors,
+                g.events.size(), g.max_size);
+    if (!width) {
+      std::printf("; skipped, elements too large\n\n");
+      return;
+    }
+    if (width != key.first) {
+      std::printf("; replayed with %zu-byte elements", width);
+    }
+    std::printf("\n  %-32s %10s %12s %12s %10s\n", "configuration",
+                "time ms", "heap KiB", "allocations", "peak KiB");
+    switch (width) {
+    case 1: replay_all<1>(g, key.second); break;
+    case 2: replay_all<2>(g, key.second); break;
+    case 4: replay_all<4>(g, key.second); break;
+    case 8: replay_all<8>(g, key.second); break;
+    case 16: replay_all<16>(g, key.second); break;
+    case 32: replay_all<32>(g, key.second); break;
+    case 64: replay_all<64>(g, key.second); break;
+    case 128: replay_all<128>(g, key.second); break;
+    }
+    std::printf("\n");
+  }
+
+  bool more_events(const std::pair<type_key, const trace_group*>& a,
+                   const std::pair<type_key, const trace_group*>& b) {
+    return a.second->events.size() > b.second->events.size();
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* path = NULL;
+  std::size_t top = 0;
+  for (int i=1; i<argc; ++i) {
+    if (!std::strcmp(argv[i], "--repetitions") && i + 1 < argc) {
+      repetitions = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--top") && i + 1 < argc) {
+      top = std::strtoul(argv[++i], NULL, 0);
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      path = NULL;
+      break;
+    }
+  }
+  if (!path) {
+    std::fprintf(stderr, "Usage: %s [--repetitions n] [--top k] trace\n",
+                 argv[0]);
+    return 2;
+  }
+
+  std::map<type_key, trace_group> groups;
+  std::size_t skipped;
+  if (!load(path, groups, skipped)) {
+    return 1;
+  }
+  if (skipped) {
+    std::printf("%zu records for vectors constructed outside the trace "
+                "skipped\n\n", skipped);
+  }
+
+  // Busiest types first
+  std::vector<std::pair<type_key, const trace_group*> > order;
+  for (std::map<type_key, trace_group>::const_iterator i = groups.begin();
+       i != groups.end(); ++i) {
+    order.push_back(std::make_pair(i->first, &i->second));
+  }
+  std::stable_sort(order.begin(), order.end(), more_events);
+  if (top && order.size() > top) {
+    order.resize(top);
+  }
+  for (std::size_t i=0; i<order.size(); ++i) {
+    replay_group(order[i].first, *order[i].second);
+  }
+  return 0;
+}
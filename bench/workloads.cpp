@@ -0,0 +1,298 @@
+// End-to-end workloads shaped like real uses of small_vector, each run
+// with std::vector and with small_vector at several small sizes:
+//
+//   ast     a 1M-node tree whose child counts follow a Zipf law (most
+//           nodes have 0-2 children, a few have dozens), built
+//           breadth-first and then walked depth-first
+//   bfs     a 200k-vertex graph with Zipf-distributed degrees, built as
+//           adjacency lists and then searched breadth-first
+//   tokens  lines of text split into (offset, length) tokens, with one
+//           output buffer cleared and reused for every line
+//
+// Each row gives the time to build and to use the structure, the cache
+// misses while using it (where perf_event_open is permitted), and the
+// heap memory it holds at the end of the build.
+//
+// Usage: workloads [--trace file] [filter]
+//
+// Built with SMALLVECTOR_TRACE (make workloads_traced), --trace records
+// every small_vector operation to file, for bench/replay.cpp.
+
+#include "small_vector.h"
+#include "bench.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+  using bench::lcg;
+
+  // Draws k in [0, max] with probability proportional to 1 / (k + 1)^s
+  class zipf {
+  public:
+    zipf(unsigned max, double s) {
+      double total = 0;
+      for (unsigned k=0; k<=max; ++k) {
+        total += 1 / std::pow(k + 1.0, s);
+        m_cdf.push_back(total);
+      }
+      for (unsigned k=0; k<=max; ++k) m_cdf[k] /= total;
+    }
+    unsigned operator()(lcg& rng) const {
+      const double u = rng.uniform();
+      unsigned k = 0;
+      while (k + 1 < m_cdf.size() && m_cdf[k] < u) ++k;
+      return k;
+    }
+  private:
+    std::vector<double> m_cdf;
+  };
+
+  const char* filter = NULL;
+
+  struct phase_result {
+    double build_ms;
+    double use_ms;
+    long long misses;       // -1 if not available
+    long long heap_bytes;
+  };
+
+  void print_row(const char* workload, const char* container,
+                 const phase_result& r) {
+    std::printf("%-8s %-24s %10.1f %10.1f", workload, container,
+                r.build_ms, r.use_ms);
+    if (r.misses >= 0) {
+      std::printf(" %14lld", r.misses);
+    } else {
+      std::printf(" %14s", "n/a");
+    }
+    std::printf(" %10.1f\n", r.heap_bytes / 1048576.0);
+    std::fflush(stdout);
+  }
+
+  // Times build(), then use() with cache misses counted
+  template <class Build, class Use>
+  phase_result run(Build build, Use use) {
+    bench::perf_counter misses(PERF_TYPE_HARDWARE,
+                               PERF_COUNT_HW_CACHE_MISSES);
+    phase_result r;
+    const long long heap_before = bench::heap_bytes();
+    double start = bench::now();
+    build();
+    r.build_ms = (bench::now() - start) * 1e3;
+    r.heap_bytes = bench::heap_bytes() - heap_before;
+
+    misses.start();
+    start = bench::now();
+    use();
+    r.use_ms = (bench::now() - start) * 1e3;
+    const unsigned long long n = misses.stop();
+    r.misses = misses.valid() ? static_cast<long long>(n) : -1;
+    return r;
+  }
+
+  bool selected(const char* workload, const char* container) {
+    return !filter || std::strstr(workload, filter) ||
+           std::strstr(container, filter);
+  }
+
+  template <class T, std::size_t N>
+  struct vector_of {
+    typedef small_vector<T, N, bench::counting_allocator<T> > type;
+  };
+  template <class T>
+  struct vector_of<T, 0> {
+    typedef std::vector<T, bench::counting_allocator<T> > type;
+  };
+
+  // ast: nodes hold their children's indices
+  template <std::size_t N>
+  void ast(const char* container) {
+    if (!selected("ast", container)) return;
+    typedef typename vector_of<unsigned, N>::type children_type;
+    struct node {
+      int value;
+      children_type children;
+    };
+    const unsigned Nodes = 1000000;
+    const zipf child_count(32, 1.2);
+
+    std::vector<node, bench::counting_allocator<node> > tree;
+    long long sum = 0;
+    const phase_result r = run([&] {
+      lcg rng(1);
+      tree.reserve(Nodes);
+      tree.push_back(node());
+      for (unsigned parent=0; parent<tree.size() && tree.size()<Nodes;
+           ++parent) {
+        // The root always has children, so the tree can't die out
+        unsigned k = child_count(rng);
+        if (parent == 0 && k == 0) k = 1;
+        for (unsigned c=0; c<k && tree.size()<Nodes; ++c) {
+          tree[parent].children.push_back(tree.size());
+          tree.push_back(node());
+          tree.back().value = static_cast<int>(rng.next() % 100);
+        }
+      }
+    }, [&] {
+      for (int pass=0; pass<5; ++pass) {
+        std::vector<unsigned> stack(1, 0);
+        while (!stack.empty()) {
+          const node& n = tree[stack.back()];
+          stack.pop_back();
+          sum += n.value;
+          for (typename children_type::const_iterator i = n.children.begin();
+               i != n.children.end(); ++i) {
+            stack.push_back(*i);
+          }
+        }
+      }
+    });
+    bench::do_not_optimize(sum);
+    print_row("ast", container, r);
+  }
+
+  // bfs: adjacency lists of vertex indices
+  template <std::size_t N>
+  void bfs(const char* container) {
+    if (!selected("bfs", container)) return;
+    typedef typename vector_of<unsigned, N>::type edges_type;
+    const unsigned Vertices = 200000;
+    const zipf degree(64, 1.1);
+
+    std::vector<edges_type, bench::counting_allocator<edges_type> > graph;
+    long long reached = 0;
+    const phase_result r = run([&] {
+      lcg rng(2);
+      graph.resize(Vertices);
+      for (unsigned v=0; v<Vertices; ++v) {
+        // Half the edges from each vertex, the other half come from the
+        // other end; the ring keeps the graph connected
+        const unsigned k = degree(rng) / 2;
+        for (unsigned e=0; e<=k; ++e) {
+          const unsigned w = e ? rng.next() % Vertices : (v + 1) % Vertices;
+          graph[v].push_back(w);
+          graph[w].push_back(v);
+        }
+      }
+    }, [&] {
+      std::vector<int> distance(Vertices);
+      std::vector<unsigned> frontier, next;
+      for (unsigned source=0; source<5; ++source) {
+        std::fill(distance.begin(), distance.end(), -1);
+        distance[source] = 0;
+        frontier.assign(1, source);
+        while (!frontier.empty()) {
+          next.clear();
+          for (std::size_t f=0; f<frontier.size(); ++f) {
+            const edges_type& edges = graph[frontier[f]];
+            for (typename edges_type::const_iterator i = edges.begin();
+                 i != edges.end(); ++i) {
+              if (distance[*i] < 0) {
+                distance[*i] = distance[frontier[f]] + 1;
+                next.push_back(*i);
+                ++reached;
+              }
+            }
+          }
+          frontier.swap(next);
+        }
+      }
+    });
+    bench::do_not_optimize(reached);
+    print_row("bfs", container, r);
+  }
+
+  struct token {
+    unsigned offset;
+    unsigned length;
+  };
+
+  // tokens: the text is built first; the use phase tokenizes it
+  template <std::size_t N>
+  void tokens(const char* container) {
+    if (!selected("tokens", container)) return;
+    typedef typename vector_of<token, N>::type tokens_type;
+    const unsigned Lines = 500000;
+
+    std::vector<char> text;
+    std::vector<unsigned> line_starts;
+    unsigned long long total = 0;
+    const phase_result r = run([&] {
+      lcg rng(3);
+      const zipf words(40, 0.8);
+      for (unsigned l=0; l<Lines; ++l) {
+        line_starts.push_back(text.size());
+        const unsigned n = 1 + words(rng);
+        for (unsigned w=0; w<n; ++w) {
+          const unsigned length = 1 + rng.next() % 9;
+          for (unsigned c=0; c<length; ++c) text.push_back('a' + c);
+          text.push_back(w + 1 < n ? ' ' : '\n');
+        }
+      }
+    }, [&] {
+      tokens_type line;
+      for (unsigned l=0; l<Lines; ++l) {
+        line.clear();
+        unsigned start = line_starts[l];
+        for (unsigned i=start; ; ++i) {
+          if (text[i] == ' ' || text[i] == '\n') {
+            const token t = { start, i - start };
+            line.push_back(t);
+            start = i + 1;
+            if (text[i] == '\n') break;
+          }
+        }
+        for (typename tokens_type::const_iterator t = line.begin();
+             t != line.end(); ++t) {
+          total += t->length;
+        }
+      }
+    });
+    bench::do_not_optimize(total);
+    print_row("tokens", container, r);
+  }
+}
+
+int main(int argc, char** argv) {
+  for (int i=1; i<argc; ++i) {
+#ifdef SMALLVECTOR_TRACE
+    if (!std::strcmp(argv[i], "--trace") && i + 1 < argc) {
+      if (!small_vector_trace::start(argv[++i])) {
+        std::perror(argv[i]);
+        return 1;
+      }
+      continue;
+    }
+#endif
+    if (argv[i][0] == '-' || filter) {
+      std::fprintf(stderr, "Usage: %s [--trace file] [filter]\n", argv[0]);
+      return 2;
+    }
+    filter = argv[i];
+  }
+  std::printf("%-8s %-24s %10s %10s %14s %10s\n", "workload", "container",
+              "build ms", "use ms", "cache misses", "heap MiB");
+
+  ast<0>("std::vector");
+  ast<1>("small_vector<N = 1>");
+  ast<2>("small_vector<N = 2>");
+  ast<4>("small_vector<N = 4>");
+  ast<8>("small_vector<N = 8>");
+
+  bfs<0>("std::vector");
+  bfs<4>("small_vector<N = 4>");
+  bfs<8>("small_vector<N = 8>");
+  bfs<16>("small_vector<N = 16>");
+
+  tokens<0>("std::vector");
+  tokens<8>("small_vector<N = 8>");
+  tokens<16>("small_vector<N = 16>");
+  tokens<32>("small_vector<N = 32>");
+#ifdef SMALLVECTOR_TRACE
+  small_vector_trace::stop();
+#endif
+  return 0;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "small_vector.h"
+
+#include <cstddef>      // std::size_t, std::ptrdiff_t
+#include <memory>       // std::allocator
+#include <new>          // placement new
+
+// A caller-provided buffer for buffer_allocator, and whether a container
+// is using it. The caller owns this and the memory it points to; every
+// allocator made from it, and every copy of those, share the one flag,
+// so the buffer is never handed out twice.
+template <class T>
+class buffer_resource {
+public:
+  buffer_resource(T* data, ::std::size_t capacity) :
+    m_data(data),
+    m_capacity(capacity),
+    m_in_use(false) {
+  }
+
+  T* data() const { return m_data; }
+  ::std::size_t capacity() const { return m_capacity; }
+  bool in_use() const { return m_in_use; }
+
+  // Claims the buffer for n elements if it's free and big enough
+  bool acquire(::std::size_t n) {
+    if (m_in_use || n > m_capacity || !m_data) {
+      return false;
+    }
+    m_in_use = true;
+    return true;
+  }
+  void release() { m_in_use = false; }
+
+private:
+  T* m_data;
+  ::std::size_t m_capacity;
+  bool m_in_use;
+
+  buffer_resource(const buffer_resource&);
+  buffer_resource& operator=(const buffer_resource&);
+};
+
+// An allocator that hands out a caller-provided buffer first, and falls
+// back on Upstream once the buffer is too small or already in use. It
+// gives a small_vector a second tier of storage between its inline
+// elements and the heap, e.g. a bigger array on the caller's stack or a
+// per-thread scratch slab, without making SmallSize bigger:
+//
+//   int scratch[256];
+//   buffer_resource<int> buffer(scratch, 256);
+//   small_vector<int, 8, buffer_allocator<int> > vec(
+//     (buffer_allocator<int>(buffer)));
+//
+// The vector spills from its 8 inline elements into all 256 of scratch,
+// and only then to the heap. The buffer_resource must outlive the
+// vector. Allocators made from the same buffer_resource compare equal
+// and share it: whichever container asks first gets the buffer, and the
+// others go to Upstream until it is given back.
+//
+// owns() tells whether a pointer is the buffer. A vector in the buffer
+// stays there on shrink_to_fit(), rather than moving to a smaller block
+// from Upstream, unless it fits in its small storage. Copies of a
+// container don't share the buffer: select_on_container_copy_construction
+// gives them an allocator that only uses Upstream.
+template <class T, class Upstream = ::std::allocator<T> >
+class buffer_allocator {
+  typedef small_vector_allocator_traits<Upstream> upstream_traits;
+public:
+  typedef T                   value_type;
+  typedef T*                  pointer;
+  typedef const T*            const_pointer;
+  typedef T&                  reference;
+  typedef const T&            const_reference;
+  typedef ::std::size_t       size_type;
+  typedef ::std::ptrdiff_t    difference_type;
+  typedef buffer_resource<T>  resource_type;
+  template <class U>
+  struct rebind {
+    typedef buffer_allocator<
+      U, typename upstream_traits::template rebind<U>::other> other;
+  };
+
+  // Without a buffer, this is just Upstream
+  explicit buffer_allocator(const Upstream& upstream = Upstream()) :
+    m_upstream(upstream),
+    m_resource(NULL) {
+  }
+
+  explicit buffer_allocator(resource_type& resource,
+                            const Upstream& upstream = Upstream()) :
+    m_upstream(upstream),
+    m_resource(&resource) {
+  }
+
+  // Only meaningful for rebinding; the result doesn't get the buffer,
+  // which holds objects of the wrong type.
+  template <class U, class OtherUpstream>
+  buffer_allocator(const buffer_allocator<U, OtherUpstream>& rhs) :
+    m_upstream(rhs.upstream()),
+    m_resource(NULL) {
+  }
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  pointer allocate(size_type n, const void* = 0) {
+    size_type count;
+    return allocate_at_least(n, count);
+  }
+
+  // Hands out the whole buffer if it's free and big enough
+  pointer allocate_at_least(size_type n, size_type& count) {
+    if (m_resource && m_resource->acquire(n)) {
+      count = m_resource->capacity();
+      return m_resource->data();
+    }
+    count = n;
+    return upstream_traits::allocate(m_upstream, n);
+  }
+
+  void deallocate(pointer p, size_type n) {
+    if (owns(p)) {
+      m_resource->release();
+    } else {
+      upstream_traits::deallocate(m_upstream, p, n);
+    }
+  }
+
+  size_type max_size() const { return upstream_traits::max_size(m_upstream); }
+
+  void construct(pointer p, const T& value) { new (p) T(value); }
+  void destroy(pointer p) { p->~T(); }
+
+  buffer_allocator<T, Upstream> select_on_container_copy_construction() const {
+    return buffer_allocator<T, Upstream>(
+      upstream_traits::select_on_container_copy_construction(m_upstream));
+  }
+
+  // Whether p is the start of the caller's buffer
+  bool owns(const T* p) const { return p && p == buffer(); }
+
+  const Upstream& upstream() const { return m_upstream; }
+  resource_type* resource() const { return m_resource; }
+  T* buffer() const { return m_resource ? m_resource->data() : NULL; }
+  size_type buffer_capacity() const {
+    return m_resource ? m_resource->capacity() : 0;
+  }
+
+private:
+  Upstream m_upstream;
+  resource_type* m_resource;
+};
+
+// Equal if both share the same buffer_resource, or have none, and have
+// equal upstreams
+template <class T, class U, class Upstream1, class Upstream2>
+bool operator==(const buffer_allocator<T, Upstream1>& lhs,
+                const buffer_allocator<U, Upstream2>& rhs) {
+  return static_cast<const void*>(lhs.resource()) ==
+         static_cast<const void*>(rhs.resource()) &&
+         lhs.upstream() == rhs.upstream();
+}
+template <class T, class U, class Upstream1, class Upstream2>
+bool operator!=(const buffer_allocator<T, Upstream1>& lhs,
+                const buffer_allocator<U, Upstream2>& rhs) {
+  return !(lhs == rhs);
+}
+
+template <class T, class Upstream>
+struct small_vector_allocator_fixed_block< buffer_allocator<T, Upstream> > {
+  static bool owns(const buffer_allocator<T, Upstream>& allocator,
+                   const T* p) {
+    return allocator.owns(p);
+  }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>      // std::size_t, std::ptrdiff_t
+#include <cstdlib>      // std::malloc, std::realloc, std::free
+#include <cstring>      // std::memcpy
+#include <new>          // std::bad_alloc, placement new
+#include <sys/mman.h>   // mmap, mremap, munmap, madvise
+#include <unistd.h>     // sysconf
+
+// An allocator for small_vectors that occasionally grow very large.
+// Allocations of at least ThresholdBytes are anonymous memory mappings;
+// smaller ones come from malloc. Through reallocate(), growing a mapped
+// buffer is an mremap, so the pages are moved by the kernel rather than
+// copied, and shrinking one hands the unused pages back to the OS.
+// Buffers below the threshold are resized with realloc.
+//
+// small_vector only calls reallocate() for trivially relocatable element
+// types (see small_vector_trivially_relocatable); for anything else this
+// behaves like a malloc-backed allocator that maps large buffers.
+//
+// If HugePages is true, mapped buffers are advised with MADV_HUGEPAGE
+// where the platform supports it.
+template <class T,
+          ::std::size_t ThresholdBytes = 1024 * 1024,
+          bool HugePages = false>
+class mmap_allocator {
+public:
+  typedef T                   value_type;
+  typedef T*                  pointer;
+  typedef const T*            const_pointer;
+  typedef T&                  reference;
+  typedef const T&            const_reference;
+  typedef ::std::size_t       size_type;
+  typedef ::std::ptrdiff_t    difference_type;
+  template <class U>
+  struct rebind { typedef mmap_allocator<U, ThresholdBytes, HugePages> other; };
+
+  mmap_allocator() {}
+  template <class U>
+  mmap_allocator(const mmap_allocator<U, ThresholdBytes, HugePages>&) {}
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  pointer allocate(size_type n, const void* = 0) {
+    void* p;
+    if (is_mapped(n)) {
+      p = ::mmap(NULL, mapped_bytes(n), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) {
+        throw ::std::bad_alloc();
+      }
+      advise(p, mapped_bytes(n));
+    } else {
+      p = ::std::malloc(n * sizeof(T));
+      if (!p && n != 0) {
+        throw ::std::bad_alloc();
+      }
+    }
+    return static_cast<pointer>(p);
+  }
+
+  void deallocate(pointer p, size_type n) {
+    if (is_mapped(n)) {
+      ::munmap(p, mapped_bytes(n));
+    } else {
+      ::std::free(p);
+    }
+  }
+
+  // Resizes the buffer at p from old_n to new_n objects, keeping the
+  // bytes of the first min(old_n, new_n) of them. The old buffer is
+  // freed. Throws bad_alloc and leaves p untouched on failure.
+  pointer reallocate(pointer p, size_type old_n, size_type new_n) {
+    const bool was_mapped = is_mapped(old_n);
+    const bool mapped = is_mapped(new_n);
+
+    void* q;
+    if (was_mapped && mapped) {
+#ifdef MREMAP_MAYMOVE
+      q = ::mremap(p, mapped_bytes(old_n), mapped_bytes(new_n),
+                   MREMAP_MAYMOVE);
+      if (q == MAP_FAILED) {
+        throw ::std::bad_alloc();
+      }
+      if (new_n > old_n) {
+        advise(q, mapped_bytes(new_n));
+      }
+      return static_cast<pointer>(q);
+#endif
+    } else if (!was_mapped && !mapped) {
+      q = ::std::realloc(static_cast<void*>(p), new_n * sizeof(T));
+      if (!q && new_n != 0) {
+        throw ::std::bad_alloc();
+      }
+      return static_cast<pointer>(q);
+    }
+
+    // Crossing the threshold, in either direction
+    pointer r = allocate(new_n);
+    ::std::memcpy(static_cast<void*>(r), static_cast<const void*>(p),
+                  (old_n < new_n ? old_n : new_n) * sizeof(T));
+    deallocate(p, old_n);
+    return r;
+  }
+
+  size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+  void construct(pointer p, const T& value) { new (p) T(value); }
+  void destroy(pointer p) { p->~T(); }
+
+private:
+  static bool is_mapped(size_type n) {
+    return n * sizeof(T) >= ThresholdBytes;
+  }
+
+  // Bytes in a mapping for n objects, rounded up to whole pages
+  static size_type mapped_bytes(size_type n) {
+    static const size_type page = ::sysconf(_SC_PAGESIZE);
+    return (n * sizeof(T) + page - 1) / page * page;
+  }
+
+  static void advise(void* p, size_type bytes) {
+#ifdef MADV_HUGEPAGE
+    if (HugePages) {
+      ::madvise(p, bytes, MADV_HUGEPAGE);
+    }
+#else
+    (void)p;
+    (void)bytes;
+#endif
+  }
+};
+
+// The allocator is stateless, so all instances are interchangeable
+template <class T, class U, ::std::size_t ThresholdBytes, bool HugePages>
+bool operator==(const mmap_allocator<T, ThresholdBytes, HugePages>&,
+                const mmap_allocator<U, ThresholdBytes, HugePages>&) {
+  return true;
+}
+template <class T, class U, ::std::size_t ThresholdBytes, bool HugePages>
+bool operator!=(const mmap_allocator<T, ThresholdBytes, HugePages>&,
+                const mmap_allocator<U, ThresholdBytes, HugePages>&) {
+  return false;
+}
@@ -1,12 +1,46 @@
 #!/bin/sh
 
+# Usage: run_tests.sh [--bench-baseline file] [--bench-threshold percent]
+#
+# With --bench-baseline, the microbenchmarks are run as well, and the
+# script fails if any small_vector benchmark is more than percent
+# (default 5) slower than in file, allowing for noise. Make a baseline
+# with "make micro && ./micro --json baseline.json".
+
+bench_baseline=
+bench_threshold=5
+while [ $# -gt 0 ] ; do
+  case "$1" in
+    --bench-baseline) bench_baseline="$2" ; shift 2 ;;
+    --bench-threshold) bench_threshold="$2" ; shift 2 ;;
+    *) echo "Usage: $0 [--bench-baseline file] [--bench-threshold percent]"
+       exit 2 ;;
+  esac
+done
+
 # Build tests
-make
-if [[ $? != 0 ]] ; then
-  exit $rc
-fi
+make || exit 1
 
 # Run all tests
-./construct
-./modifiers
-./capacity
+./construct || exit 1
+./modifiers || exit 1
+./capacity || exit 1
+./io || exit 1
+./allocators || exit 1
+./stats || exit 1
+./sites || exit 1
+./sampling || exit 1
+./probes || exit 1
+./guarantees || exit 1
+./instantiations || exit 1
+./trace || exit 1
+./small_string || exit 1
+./small_flat_map || exit 1
+
+# Check for performance regressions
+if [ -n "$bench_baseline" ] ; then
+  make micro || exit 1
+  ./micro --json micro.json > /dev/null || exit 1
+  python3 bench/compare.py --threshold "$bench_threshold" \
+    --filter '/small_vector$' "$bench_baseline" micro.json || exit 1
+fi
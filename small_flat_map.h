@@ -0,0 +1,279 @@
+#pragma once
+
+#include "small_vector.h"
+
+#include <algorithm>    // std::lower_bound, std::stable_sort, std::inplace_merge
+#include <cstddef>      // std::size_t
+#include <functional>   // std::less
+#include <utility>      // std::pair
+
+// Lookups with a key other than Key are only offered when Compare has an
+// is_transparent member type, as for std::less<> and std::map. K is
+// there only to make the check depend on the lookup's own parameter.
+template <class T>
+struct small_flat_map_void { typedef void type; };
+
+template <class Compare, class K, class Result, class Check = void>
+struct small_flat_map_if_transparent {};
+
+template <class Compare, class K, class Result>
+struct small_flat_map_if_transparent<
+    Compare, K, Result,
+    typename small_flat_map_void<typename Compare::is_transparent>::type> {
+  typedef Result type;
+};
+
+// A map kept as a small_vector of (key, value) pairs sorted by key, so
+// up to SmallSize entries live inside the object with no per-entry
+// nodes. While the entries are in the small storage, lookups scan them
+// in order, which beats binary search at those sizes; once they spill,
+// lookups use binary search.
+//
+// Inserting or erasing one entry moves the entries after it, so building
+// a large map an entry at a time is quadratic; insert(first, last) sorts
+// the new entries and merges them in once instead.
+//
+// Iterators point to std::pair<Key, T>, whose key must not be modified.
+// Any insert or erase invalidates them.
+template <class Key,
+          class T,
+          ::std::size_t SmallSize,
+          class Compare = ::std::less<Key>,
+          class Allocator = ::std::allocator< ::std::pair<Key, T> > >
+class small_flat_map {
+public:
+  typedef Key                                   key_type;
+  typedef T                                     mapped_type;
+  typedef ::std::pair<Key, T>                   value_type;
+  typedef Compare                               key_compare;
+  typedef small_vector<value_type, SmallSize, Allocator> container_type;
+  typedef typename container_type::allocator_type allocator_type;
+  typedef typename container_type::iterator       iterator;
+  typedef typename container_type::const_iterator const_iterator;
+  typedef ::std::size_t                         size_type;
+
+  explicit small_flat_map(const Compare& compare = Compare(),
+                          const allocator_type& allocator = allocator_type()) :
+    m_compare(compare),
+    m_entries(allocator) {
+  }
+
+  template <class InputIterator>
+  small_flat_map(InputIterator first, InputIterator last,
+                 const Compare& compare = Compare(),
+                 const allocator_type& allocator = allocator_type()) :
+    m_compare(compare),
+    m_entries(allocator) {
+    insert(first, last);
+  }
+
+  allocator_type get_allocator() const { return m_entries.get_allocator(); }
+  key_compare key_comp() const { return m_compare; }
+
+  iterator begin() { return m_entries.begin(); }
+  const_iterator begin() const { return m_entries.begin(); }
+  iterator end() { return m_entries.end(); }
+  const_iterator end() const { return m_entries.end(); }
+
+  size_type size() const { return m_entries.size(); }
+  bool empty() const { return m_entries.empty(); }
+  size_type capacity() const { return m_entries.capacity(); }
+  void reserve(size_type n) { m_entries.reserve(n); }
+  void clear() { m_entries.clear(); }
+
+  // Whether the entries are in the object rather than on the heap
+  bool is_small() const { return m_entries.is_small(); }
+
+  // The first entry whose key is not less than key
+  iterator lower_bound(const key_type& key) {
+    return begin() + lower_bound_index(key);
+  }
+  const_iterator lower_bound(const key_type& key) const {
+    return begin() + lower_bound_index(key);
+  }
+
+  iterator find(const key_type& key) {
+    return begin() + find_index(key);
+  }
+  const_iterator find(const key_type& key) const {
+    return begin() + find_index(key);
+  }
+
+  size_type count(const key_type& key) const {
+    return find_index(key) != size();
+  }
+
+  // Heterogeneous lookup, e.g. by a const char* in a map keyed by a
+  // string type, without converting it to a Key first
+  template <class K>
+  typename small_flat_map_if_transparent<Compare, K, iterator>::type
+    lower_bound(const K& key) {
+    return begin() + lower_bound_index(key);
+  }
+  template <class K>
+  typename small_flat_map_if_transparent<Compare, K, const_iterator>::type
+    lower_bound(const K& key) const {
+    return begin() + lower_bound_index(key);
+  }
+  template <class K>
+  typename small_flat_map_if_transparent<Compare, K, iterator>::type
+    find(const K& key) {
+    return begin() + find_index(key);
+  }
+  template <class K>
+  typename small_flat_map_if_transparent<Compare, K, const_iterator>::type
+    find(const K& key) const {
+    return begin() + find_index(key);
+  }
+  template <class K>
+  typename small_flat_map_if_transparent<Compare, K, size_type>::type
+    count(const K& key) const {
+    return find_index(key) != size();
+  }
+
+  // The value for key, inserting a default-constructed one if needed
+  T& operator[](const key_type& key) {
+    const size_type i = lower_bound_index(key);
+    if (i == size() || key_less(key, m_entries[i].first)) {
+      m_entries.insert(begin() + i, value_type(key, T()));
+    }
+    return m_entries[i].second;
+  }
+
+  // Inserts x unless its key is already present. Returns where the entry
+  // with that key is, and whether it was inserted.
+  ::std::pair<iterator, bool> insert(const value_type& x) {
+    const size_type i = lower_bound_index(x.first);
+    if (i != size() && !key_less(x.first, m_entries[i].first)) {
+      return ::std::make_pair(begin() + i, false);
+    }
+    return ::std::make_pair(m_entries.insert(begin() + i, x), true);
+  }
+
+  // Inserts the entries in [first, last) whose keys aren't present yet,
+  // keeping the first of any repeated keys. New keys are appended, then
+  // sorted and merged in once. While the result fits in the small
+  // storage this is an insertion sort, which allocates nothing; past
+  // that, it is a stable sort and merge.
+  template <class InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    const size_type old_size = size();
+    for ( ; first != last; ++first) {
+      if (!contains((*first).first, old_size)) {
+        m_entries.push_back(*first);
+      }
+    }
+    if (size() == old_size) {
+      return;
+    }
+    const entry_less less(m_compare);
+    if (size() <= SmallSize) {
+      insertion_sort(old_size, less);
+    } else {
+      ::std::stable_sort(begin() + old_size, end(), less);
+      ::std::inplace_merge(begin(), begin() + old_size, end(), less);
+    }
+
+    // Keys repeated within the range are now adjacent, first one first
+    iterator to = begin();
+    for (iterator from = begin() + 1; from != end(); ++from) {
+      if (less(*to, *from)) {
+        ++to;
+        if (to != from) {
+          *to = *from;
+        }
+      }
+    }
+    m_entries.erase(to + 1, end());
+    if (!is_small() && size() <= SmallSize) {
+      m_entries.shrink_to_fit();
+    }
+  }
+
+  // Removes the entry at pos. Returns where the entry after it now is.
+  iterator erase(iterator pos) { return m_entries.erase(pos); }
+
+  // Removes the entry with key, if any. Returns how many were removed.
+  size_type erase(const key_type& key) {
+    const size_type i = find_index(key);
+    if (i == size()) {
+      return 0;
+    }
+    m_entries.erase(begin() + i);
+    return 1;
+  }
+
+private:
+  // A member rather than a base, so that it can be a function pointer
+  // or a final class, as with std::map
+  Compare m_compare;
+  container_type m_entries;
+
+  // Orders entries by key, and entries against keys of any type the
+  // comparison accepts
+  struct entry_less {
+    explicit entry_less(const Compare& c) : compare(c) {}
+    bool operator()(const value_type& a, const value_type& b) const {
+      return compare(a.first, b.first);
+    }
+    template <class K>
+    bool operator()(const value_type& a, const K& key) const {
+      return compare(a.first, key);
+    }
+    const Compare& compare;
+  };
+
+  template <class K>
+  bool key_less(const K& a, const key_type& b) const {
+    return m_compare(a, b);
+  }
+
+  // Index of the first entry whose key is not less than key
+  template <class K>
+  size_type lower_bound_index(const K& key) const {
+    const value_type* const first = m_entries.begin();
+    const value_type* const last = m_entries.end();
+    const entry_less less(m_compare);
+    if (m_entries.is_small()) {
+      const value_type* p = first;
+      while (p != last && less(*p, key)) {
+        ++p;
+      }
+      return p - first;
+    }
+    return ::std::lower_bound(first, last, key, less) - first;
+  }
+
+  // Whether key is among the first n entries, which are sorted
+  bool contains(const key_type& key, size_type n) const {
+    const value_type* const last = m_entries.begin() + n;
+    const value_type* const p = ::std::lower_bound(
+      m_entries.begin(), last, key, entry_less(m_compare));
+    return p != last && !key_less(key, p->first);
+  }
+
+  // Sorts the entries from sorted_size on into the sorted ones before
+  // them, keeping equal keys in order, without allocating
+  void insertion_sort(size_type sorted_size, const entry_less& less) {
+    for (iterator i = begin() + (sorted_size ? sorted_size : 1);
+         i < end(); ++i) {
+      if (!less(*i, *(i - 1))) {
+        continue;
+      }
+      const value_type x = *i;
+      iterator j = i;
+      do {
+        *j = *(j - 1);
+        --j;
+      } while (j != begin() && less(x, *(j - 1)));
+      *j = x;
+    }
+  }
+
+  // Index of the entry with key, or size() if there is none
+  template <class K>
+  size_type find_index(const K& key) const {
+    const size_type i = lower_bound_index(key);
+    return i != size() && !key_less(key, m_entries[i].first) ? i : size();
+  }
+};
@@ -0,0 +1,285 @@
+#pragma once
+
+#include "small_vector.h"
+
+#include <cstddef>      // std::size_t
+#include <cstring>      // std::memchr, std::memcmp, std::memcpy, std::strlen
+#include <string>       // std::string
+#if __cplusplus >= 201103L
+#include <functional>   // std::hash
+#endif
+#if __cplusplus >= 201703L
+#include <string_view>  // std::string_view
+#endif
+
+// A 64-bit multiply-and-shift hash over whole words, with the length
+// mixed in, so short strings take a couple of multiplies
+inline ::std::size_t small_string_hash_bytes(const char* p,
+                                             ::std::size_t n) {
+  const unsigned long long k = 0x9e3779b97f4a7c15ull;
+  unsigned long long h = n * k;
+  for ( ; n >= 8; p += 8, n -= 8) {
+    unsigned long long w;
+    ::std::memcpy(&w, p, 8);
+    h = (h ^ w) * k;
+    h ^= h >> 29;
+  }
+  if (n) {
+    unsigned long long w = 0;
+    ::std::memcpy(&w, p, n);
+    h = (h ^ w) * k;
+    h ^= h >> 29;
+  }
+  return static_cast< ::std::size_t>(h ^ (h >> 32));
+}
+
+// A string of chars kept in a small_vector<char, SmallSize + 1, ...>:
+// strings of up to SmallSize chars, plus their terminator, live inside
+// the object, and only longer ones go to the heap. The terminator is
+// always stored (the vector's size is length() + 1), so c_str() is free
+// and never reallocates.
+//
+// sizeof(small_string<N>) is three pointers plus N + 1 bytes, rounded
+// up, so unlike std::string, whose small buffer is fixed (15 chars in
+// libstdc++ and MSVC), the inline length can be chosen per use.
+template < ::std::size_t SmallSize,
+          class Allocator = ::std::allocator<char> >
+class small_string {
+  typedef small_vector<char, SmallSize + 1, Allocator> vector_type;
+public:
+  typedef char                              value_type;
+  typedef typename vector_type::allocator_type allocator_type;
+  typedef ::std::size_t                     size_type;
+  typedef char*                             iterator;
+  typedef const char*                       const_iterator;
+
+  static const size_type npos = static_cast<size_type>(-1);
+
+  explicit small_string(const allocator_type& allocator = allocator_type()) :
+    m_chars(1, '\0', allocator) {
+  }
+
+  small_string(const char* s,
+               const allocator_type& allocator = allocator_type()) :
+    m_chars(1, '\0', allocator) {
+    append(s, ::std::strlen(s));
+  }
+
+  small_string(const char* s, size_type n,
+               const allocator_type& allocator = allocator_type()) :
+    m_chars(1, '\0', allocator) {
+    append(s, n);
+  }
+
+  small_string(size_type n, char c,
+               const allocator_type& allocator = allocator_type()) :
+    m_chars(n + 1, c, allocator) {
+    m_chars[n] = '\0';
+  }
+
+  explicit small_string(const ::std::string& s,
+                        const allocator_type& allocator = allocator_type()) :
+    m_chars(1, '\0', allocator) {
+    append(s.data(), s.size());
+  }
+
+#if __cplusplus >= 201703L
+  explicit small_string(::std::string_view s,
+                        const allocator_type& allocator = allocator_type()) :
+    m_chars(1, '\0', allocator) {
+    append(s.data(), s.size());
+  }
+
+  operator ::std::string_view() const {
+    return ::std::string_view(data(), size());
+  }
+#endif
+
+  allocator_type get_allocator() const { return m_chars.get_allocator(); }
+
+  iterator begin() { return m_chars.begin(); }
+  const_iterator begin() const { return m_chars.begin(); }
+  iterator end() { return m_chars.end() - 1; }
+  const_iterator end() const { return m_chars.end() - 1; }
+
+  size_type size() const { return m_chars.size() - 1; }
+  size_type length() const { return size(); }
+  bool empty() const { return size() == 0; }
+  size_type capacity() const { return m_chars.capacity() - 1; }
+  void reserve(size_type n) { m_chars.reserve(n + 1); }
+  void shrink_to_fit() { m_chars.shrink_to_fit(); }
+
+  // Whether the chars are in the object rather than on the heap
+  bool is_small() const { return m_chars.is_small(); }
+
+  char& operator[](size_type i) { return m_chars[i]; }
+  const char& operator[](size_type i) const { return m_chars[i]; }
+
+  const char* c_str() const { return m_chars.begin(); }
+  const char* data() const { return m_chars.begin(); }
+  char* data() { return m_chars.begin(); }
+
+  ::std::string str() const { return ::std::string(data(), size()); }
+
+  void clear() {
+    m_chars.clear();
+    m_chars.push_back('\0');
+  }
+
+  void push_back(char c) {
+    append(&c, 1);
+  }
+
+  // Copies n chars over the terminator and one past them, with at most
+  // one reallocation. s may point into this string.
+  small_string& append(const char* s, size_type n) {
+    const char* const old_data = data();
+    const bool inside = s >= old_data && s < old_data + size();
+    char* tail = m_chars.grow_uninitialized(n) - 1;
+    if (inside) {
+      s = data() + (s - old_data);
+    }
+    ::std::memmove(tail, s, n);
+    tail[n] = '\0';
+    m_chars.commit(n);
+    return *this;
+  }
+
+  small_string& append(const char* s) {
+    return append(s, ::std::strlen(s));
+  }
+  template < ::std::size_t OtherSize, class OtherAllocator>
+  small_string& append(const small_string<OtherSize, OtherAllocator>& s) {
+    return append(s.data(), s.size());
+  }
+  small_string& append(const ::std::string& s) {
+    return append(s.data(), s.size());
+  }
+
+  small_string& operator+=(char c) {
+    push_back(c);
+    return *this;
+  }
+  small_string& operator+=(const char* s) { return append(s); }
+  template < ::std::size_t OtherSize, class OtherAllocator>
+  small_string& operator+=(const small_string<OtherSize, OtherAllocator>& s) {
+    return append(s);
+  }
+  small_string& operator+=(const ::std::string& s) { return append(s); }
+
+  // The first position at or after pos where c or the n chars at s
+  // occur, or npos
+  size_type find(char c, size_type pos = 0) const {
+    if (pos >= size()) {
+      return npos;
+    }
+    const void* p = ::std::memchr(data() + pos, c, size() - pos);
+    return p ? static_cast<const char*>(p) - data() : npos;
+  }
+
+  size_type find(const char* s, size_type pos, size_type n) const {
+    if (n == 0) {
+      return pos <= size() ? pos : npos;
+    }
+    if (pos > size() || n > size() - pos) {
+      return npos;
+    }
+    // Jump between occurrences of the first char, then compare the rest
+    const char* const last = data() + size() - n;
+    for (const char* p = data() + pos; p <= last; ++p) {
+      p = static_cast<const char*>(::std::memchr(p, s[0], last - p + 1));
+      if (!p) {
+        return npos;
+      }
+      if (::std::memcmp(p + 1, s + 1, n - 1) == 0) {
+        return p - data();
+      }
+    }
+    return npos;
+  }
+
+  size_type find(const char* s, size_type pos = 0) const {
+    return find(s, pos, ::std::strlen(s));
+  }
+  template < ::std::size_t OtherSize, class OtherAllocator>
+  size_type find(const small_string<OtherSize, OtherAllocator>& s,
+                 size_type pos = 0) const {
+    return find(s.data(), pos, s.size());
+  }
+
+  // Negative, zero or positive as this string sorts before, the same as,
+  // or after the n chars at s
+  int compare(const char* s, size_type n) const {
+    const size_type common = size() < n ? size() : n;
+    const int c = ::std::memcmp(data(), s, common);
+    if (c != 0) {
+      return c;
+    }
+    return size() < n ? -1 : size() > n ? 1 : 0;
+  }
+
+  int compare(const char* s) const { return compare(s, ::std::strlen(s)); }
+  template < ::std::size_t OtherSize, class OtherAllocator>
+  int compare(const small_string<OtherSize, OtherAllocator>& s) const {
+    return compare(s.data(), s.size());
+  }
+  int compare(const ::std::string& s) const {
+    return compare(s.data(), s.size());
+  }
+
+  // A hash of the chars, read eight at a time
+  ::std::size_t hash() const {
+    return small_string_hash_bytes(data(), size());
+  }
+
+private:
+  vector_type m_chars;
+};
+
+template < ::std::size_t SmallSize, class Allocator>
+const typename small_string<SmallSize, Allocator>::size_type
+  small_string<SmallSize, Allocator>::npos;
+
+template < ::std::size_t N1, class A1, ::std::size_t N2, class A2>
+bool operator==(const small_string<N1, A1>& a, const small_string<N2, A2>& b) {
+  return a.size() == b.size() &&
+         ::std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+template < ::std::size_t N, class A>
+bool operator==(const small_string<N, A>& a, const char* b) {
+  return a.compare(b) == 0;
+}
+template < ::std::size_t N, class A>
+bool operator==(const char* a, const small_string<N, A>& b) {
+  return b.compare(a) == 0;
+}
+
+template < ::std::size_t N1, class A1, ::std::size_t N2, class A2>
+bool operator!=(const small_string<N1, A1>& a, const small_string<N2, A2>& b) {
+  return !(a == b);
+}
+template < ::std::size_t N, class A>
+bool operator!=(const small_string<N, A>& a, const char* b) {
+  return !(a == b);
+}
+template < ::std::size_t N, class A>
+bool operator!=(const char* a, const small_string<N, A>& b) {
+  return !(a == b);
+}
+
+template < ::std::size_t N1, class A1, ::std::size_t N2, class A2>
+bool operator<(const small_string<N1, A1>& a, const small_string<N2, A2>& b) {
+  return a.compare(b) < 0;
+}
+
+#if __cplusplus >= 201103L
+namespace std {
+  template < ::std::size_t SmallSize, class Allocator>
+  struct hash< small_string<SmallSize, Allocator> > {
+    ::std::size_t operator()(
+        const small_string<SmallSize, Allocator>& s) const {
+      return s.hash();
+    }
+  };
+}
+#endif
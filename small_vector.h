@@ -1,11 +1,252 @@
 #pragma once
 
+#include <algorithm>    // std::max
 #include <cstddef>      // std::size_t, std::ptrdiff_t
+#include <iterator>     // std::iterator_traits, std::distance
+#include <limits>       // std::numeric_limits
 #include <memory>       // std::allocator
 #include <utility>      // std::move
+#if __cplusplus >= 201103L
+#include <type_traits>  // std::is_trivially_copyable
+#endif
+#ifdef SMALLVECTOR_STATS
+#include "small_vector_stats.h"
+#endif
+#ifdef SMALLVECTOR_SAMPLING
+#include "small_vector_sampling.h"
+#endif
+#ifdef SMALLVECTOR_USDT
+#include "small_vector_probes.h"
+#endif
+
+// The operations an instrumentation mode can be told about
+struct small_vector_operation {
+  enum type {
+    construct,  // The size is what the constructor filled in
+    copy,       // Copy-constructed from a vector of the size
+    push_back,
+    append,     // append() or commit()
+    reserve,    // The size is the capacity asked for
+    shrink,     // shrink_to_fit()
+    clear,
+    destroy,
+    insert,
+    erase       // erase() or pop_back(); the size is what is left
+  };
+};
+
+#ifdef SMALLVECTOR_TRACE
+#include "small_vector_trace.h"
+#endif
+
+// With SMALLVECTOR_SITES, every constructor also records its caller
+#ifdef SMALLVECTOR_SITES
+#include "small_vector_sites.h"
+#define SMALLVECTOR_SITE_PARAM \
+  , const small_vector_site& site = small_vector_site::current()
+#define SMALLVECTOR_SITE_INIT , m_site(site)
+#else
+#define SMALLVECTOR_SITE_PARAM
+#define SMALLVECTOR_SITE_INIT
+#endif
 
 //#define SMALLVECTOR_HAS_MOVE
 
+template <bool Value>
+struct small_vector_bool {};
+
+// small_vector talks to its allocator only through these traits. From
+// C++11 on they are std::allocator_traits, so allocators only need to
+// provide what the standard requires of them. Before that, allocators
+// must provide the full C++03 interface and these just forward to it.
+#if __cplusplus >= 201103L
+template <class Allocator>
+struct small_vector_allocator_traits : ::std::allocator_traits<Allocator> {
+  template <class U>
+  struct rebind {
+    typedef typename ::std::allocator_traits<Allocator>::
+      template rebind_alloc<U> other;
+  };
+};
+#else
+// Whether Allocator has its own select_on_container_copy_construction()
+template <class Allocator>
+struct small_vector_has_select_on_copy {
+private:
+  template <class U, U (U::*)() const>
+  struct check {};
+  template <class U>
+  static char test(check<U, &U::select_on_container_copy_construction>*);
+  template <class U>
+  static char (&test(...))[2];
+public:
+  static const bool value = sizeof(test<Allocator>(0)) == 1;
+};
+
+template <class Allocator>
+struct small_vector_allocator_traits {
+  typedef Allocator                             allocator_type;
+  typedef typename Allocator::value_type        value_type;
+  typedef typename Allocator::pointer           pointer;
+  typedef typename Allocator::const_pointer     const_pointer;
+  typedef typename Allocator::size_type         size_type;
+  typedef typename Allocator::difference_type   difference_type;
+  template <class U>
+  struct rebind {
+    typedef typename Allocator::template rebind<U>::other other;
+  };
+
+  // C++03 allocators can't ask to be propagated
+  struct propagate_on_container_copy_assignment {
+    static const bool value = false;
+  };
+
+  static pointer allocate(Allocator& a, size_type n) {
+    return a.allocate(n);
+  }
+  static void deallocate(Allocator& a, pointer p, size_type n) {
+    a.deallocate(p, n);
+  }
+  template <class U>
+  static void construct(Allocator& a, pointer p, const U& value) {
+    a.construct(p, value);
+  }
+  static void destroy(Allocator& a, pointer p) {
+    a.destroy(p);
+  }
+  static size_type max_size(const Allocator& a) {
+    return a.max_size();
+  }
+  static Allocator select_on_container_copy_construction(const Allocator& a) {
+    return select_on_copy(
+      a, small_vector_bool<small_vector_has_select_on_copy<Allocator>::value>());
+  }
+private:
+  static Allocator select_on_copy(const Allocator& a, small_vector_bool<true>) {
+    return a.select_on_container_copy_construction();
+  }
+  static Allocator select_on_copy(const Allocator& a, small_vector_bool<false>) {
+    return a;
+  }
+};
+#endif
+
+// Whether objects of type T can be moved to a new address by copying
+// their bytes, without running a constructor or destructor. Allocators
+// that can move memory themselves (see small_vector_can_reallocate) are
+// only used for such types. Specialize this for your own types if they
+// qualify.
+#if __cplusplus >= 201103L
+template <class T>
+struct small_vector_trivially_relocatable {
+  static const bool value = ::std::is_trivially_copyable<T>::value;
+};
+#else
+template <class T>
+struct small_vector_trivially_relocatable {
+  static const bool value = false;
+};
+template <class T>
+struct small_vector_trivially_relocatable<T*> {
+  static const bool value = true;
+};
+#define SMALLVECTOR_TRIVIALLY_RELOCATABLE(type)       \
+  template <>                                         \
+  struct small_vector_trivially_relocatable<type> {   \
+    static const bool value = true;                   \
+  };
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(bool)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(char)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(signed char)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(unsigned char)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(wchar_t)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(short)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(unsigned short)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(int)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(unsigned int)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(long)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(unsigned long)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(float)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(double)
+SMALLVECTOR_TRIVIALLY_RELOCATABLE(long double)
+#undef SMALLVECTOR_TRIVIALLY_RELOCATABLE
+#endif
+
+// Whether Allocator has a member
+//   pointer reallocate(pointer p, size_type old_n, size_type new_n);
+// that moves the bytes of an allocation of old_n objects into one of
+// new_n objects and frees the old one, like realloc. small_vector uses
+// it instead of allocate-move-deallocate when the elements are trivially
+// relocatable and live on the heap.
+template <class Allocator>
+struct small_vector_can_reallocate {
+private:
+  typedef small_vector_allocator_traits<Allocator> traits;
+  typedef typename traits::pointer pointer;
+  typedef typename traits::size_type size_type;
+  template <class U, pointer (U::*)(pointer, size_type, size_type)>
+  struct check {};
+  template <class U>
+  static char test(check<U, &U::reallocate>*);
+  template <class U>
+  static char (&test(...))[2];
+public:
+  static const bool value = sizeof(test<Allocator>(0)) == 1;
+};
+
+// Whether Allocator has a member
+//   pointer allocate_at_least(size_type n, size_type& count);
+// that allocates room for at least n objects and stores how many it
+// actually made room for in count. small_vector uses all of it as
+// capacity, and later deallocates it with count or any size between
+// n and count.
+template <class Allocator>
+struct small_vector_can_allocate_at_least {
+private:
+  typedef small_vector_allocator_traits<Allocator> traits;
+  typedef typename traits::pointer pointer;
+  typedef typename traits::size_type size_type;
+  template <class U, pointer (U::*)(size_type, size_type&)>
+  struct check {};
+  template <class U>
+  static char test(check<U, &U::allocate_at_least>*);
+  template <class U>
+  static char (&test(...))[2];
+public:
+  static const bool value = sizeof(test<Allocator>(0)) == 1;
+};
+
+// Whether destroying an object of type T is a no-op
+template <class T>
+struct small_vector_trivially_destructible {
+#if __cplusplus >= 201103L
+  static const bool value = ::std::is_trivially_destructible<T>::value;
+#else
+  static const bool value = __has_trivial_destructor(T);
+#endif
+};
+
+// Whether Allocator never gives memory back before it is itself torn
+// down, as with an arena that is dropped all at once. Specialize this
+// for such allocators. For trivially destructible elements, a
+// small_vector using one doesn't need to do anything on destruction.
+template <class Allocator>
+struct small_vector_allocator_is_monotonic {
+  static const bool value = false;
+};
+
+// Whether p, a block from allocator, is fixed storage such as a buffer
+// the caller handed to the allocator. shrink_to_fit() leaves such a
+// block alone, since a smaller block would have to come from elsewhere.
+// Specialize this for such allocators.
+template <class Allocator>
+struct small_vector_allocator_fixed_block {
+  static bool owns(const Allocator&,
+                   const typename Allocator::value_type*) {
+    return false;
+  }
+};
+
 template <class T, ::std::size_t SmallSize>
 class small_vector_storage {
 protected:
@@ -46,114 +287,192 @@ private:
     operator=(const small_vector_storage<T, 0>&);
 };
 
+// Allocator is rebound to T if it is for some other type. Its pointer
+// type must be T*.
 template <class T,
           ::std::size_t SmallSize,
           class Allocator = ::std::allocator<T> >
 class small_vector : private small_vector_storage<T, SmallSize>,
-                     private Allocator {
+                     private small_vector_allocator_traits<Allocator>::
+                       template rebind<T>::other {
   typedef small_vector_storage<T, SmallSize> storage_base;
+  typedef typename small_vector_allocator_traits<Allocator>::
+    template rebind<T>::other allocator_base;
+  typedef small_vector_allocator_traits<allocator_base> alloc_traits;
 public:
   typedef T                   value_type;
-  typedef Allocator           allocator_type;
+  typedef allocator_base      allocator_type;
   typedef value_type&         reference;
   typedef const value_type&   const_reference;
   typedef T*                  iterator;
   typedef const T*            const_iterator;
   typedef ::std::size_t       size_type;
   typedef ::std::ptrdiff_t    difference_type;
-  // Check the standard on these two. Supposed to use std::allocator_traits
-  typedef T*                  pointer;
-  typedef const T*            const_pointer;
+  typedef typename alloc_traits::pointer        pointer;
+  typedef typename alloc_traits::const_pointer  const_pointer;
   typedef ::std::reverse_iterator<iterator>       reverse_iterator;
   typedef ::std::reverse_iterator<const_iterator> const_reverse_iterator;
 
   // 23.3.6.2, construct/copy/destroy:
-  explicit small_vector(const Allocator& allocator = Allocator()) :
-    Allocator(allocator),
+  explicit small_vector(const allocator_type& allocator = allocator_type()
+                        SMALLVECTOR_SITE_PARAM) :
+    storage_base(),
+    allocator_base(allocator),
     m_begin(storage_base::small_begin()),
     m_end(storage_base::small_begin()),
-    m_capacity_end(storage_base::small_end()) {
+    m_capacity_end(storage_base::small_end())
+    SMALLVECTOR_SITE_INIT {
+    note_construct(false);
   }
 
-  explicit small_vector(size_type n) :
+  explicit small_vector(size_type n SMALLVECTOR_SITE_PARAM) :
+    storage_base(),
+    allocator_base(),
     m_begin(storage_base::small_begin()),
     m_end(storage_base::small_begin()),
-    m_capacity_end(storage_base::small_end()) {
-
-    // If n is greater than the small size, allocate
-    // memory first. Otherwise we can use our small storage.
-    if (n > SmallSize) {
-      m_begin = Allocator::allocate(n);
-      m_capacity_end = m_begin + n;
-    }
-    m_end = m_begin + n;
+    m_capacity_end(storage_base::small_end())
+    SMALLVECTOR_SITE_INIT {
 
     // Fill our range with a default-constructed value
-    uninitialized_fill(m_begin, m_end, T());
+    fill_construct(n, T());
+    note_construct(false);
   }
 
-  small_vector(size_type n, const T& value,
-               const Allocator& = Allocator() ) :
+  small_vector(size_type n, const allocator_type& allocator
+               SMALLVECTOR_SITE_PARAM) :
+    storage_base(),
+    allocator_base(allocator),
     m_begin(storage_base::small_begin()),
     m_end(storage_base::small_begin()),
-    m_capacity_end(storage_base::small_end()) {
+    m_capacity_end(storage_base::small_end())
+    SMALLVECTOR_SITE_INIT {
 
-    // If n is greater than the small size, allocate
-    // memory first. Otherwise we can use our small storage.
-    if (n > SmallSize) {
-      m_begin = Allocator::allocate(n);
-      m_capacity_end = m_begin + n;
-    }
-    m_end = m_begin + n;
+    fill_construct(n, T());
+    note_construct(false);
+  }
 
-    // Fill our range with a default-constructed value
-    uninitialized_fill(m_begin, m_end, value);
+  small_vector(size_type n, const T& value,
+               const allocator_type& allocator = allocator_type()
+               SMALLVECTOR_SITE_PARAM) :
+    storage_base(),
+    allocator_base(allocator),
+    m_begin(storage_base::small_begin()),
+    m_end(storage_base::small_begin()),
+    m_capacity_end(storage_base::small_end())
+    SMALLVECTOR_SITE_INIT {
+
+    fill_construct(n, value);
+    note_construct(false);
   }
 
   template <class InputIterator>
   small_vector(InputIterator first, InputIterator last,
-               const Allocator& = Allocator()) :
+               const allocator_type& allocator = allocator_type()
+               SMALLVECTOR_SITE_PARAM) :
+    storage_base(),
+    allocator_base(allocator),
     m_begin(storage_base::small_begin()),
     m_end(storage_base::small_begin()),
-    m_capacity_end(storage_base::small_end()) {
+    m_capacity_end(storage_base::small_end())
+    SMALLVECTOR_SITE_INIT {
 
     typedef
       typename ::std::iterator_traits<InputIterator>::iterator_category
       iterator_category;
     range_construct(first, last, iterator_category());
+    note_construct(false);
   }
 
+  // Copies get whatever allocator select_on_container_copy_construction
+  // picks for them, which is usually a copy of x's.
   template <size_type OtherSize>
-  small_vector(const small_vector<T, OtherSize, Allocator>& x) :
+  small_vector(const small_vector<T, OtherSize, Allocator>& x
+               SMALLVECTOR_SITE_PARAM) :
+    storage_base(),
+    allocator_base(
+      alloc_traits::select_on_container_copy_construction(
+        x.get_allocator())),
     m_begin(storage_base::small_begin()),
     m_end(storage_base::small_begin()),
-    m_capacity_end(storage_base::small_end()) {
+    m_capacity_end(storage_base::small_end())
+    SMALLVECTOR_SITE_INIT {
 
     range_construct(x.begin(), x.end(),
                     std::random_access_iterator_tag());
+    note_construct(true);
   }
 
   // Need a separate non-templated copy constructor, otherwise
   // the default copy constructor gets synthesized and used
-  small_vector(const small_vector<T, SmallSize, Allocator>& x) :
+  small_vector(const small_vector<T, SmallSize, Allocator>& x
+               SMALLVECTOR_SITE_PARAM) :
+    storage_base(),
+    allocator_base(
+      alloc_traits::select_on_container_copy_construction(x.alloc())),
     m_begin(storage_base::small_begin()),
     m_end(storage_base::small_begin()),
-    m_capacity_end(storage_base::small_end()) {
+    m_capacity_end(storage_base::small_end())
+    SMALLVECTOR_SITE_INIT {
 
     range_construct(x.begin(), x.end(),
                     std::random_access_iterator_tag());
+    note_construct(true);
   }
 
+  // Copy construct using a different allocator. This is also what
+  // uses-allocator construction calls, so a small_vector of
+  // small_vectors hands its allocator down to the inner vectors.
+  small_vector(const small_vector<T, SmallSize, Allocator>& x,
+               const allocator_type& allocator
+               SMALLVECTOR_SITE_PARAM) :
+    storage_base(),
+    allocator_base(allocator),
+    m_begin(storage_base::small_begin()),
+    m_end(storage_base::small_begin()),
+    m_capacity_end(storage_base::small_end())
+    SMALLVECTOR_SITE_INIT {
+
+    range_construct(x.begin(), x.end(),
+                    std::random_access_iterator_tag());
+    note_construct(true);
+  }
 
   ~small_vector() {
+    note_destroy();
+
+    // Nothing to destroy and nothing to free
+    if (small_vector_trivially_destructible<T>::value &&
+        small_vector_allocator_is_monotonic<allocator_base>::value) {
+      return;
+    }
+
     // Destroy our objects
     destroy_range(m_begin, m_end);
     // Free our memory if not using the small storage
     if (!is_small()) {
-      Allocator::deallocate(m_begin, capacity());
+      alloc_traits::deallocate(alloc(), m_begin, capacity());
     }
   }
 
+  // Takes x's allocator too if the allocator asks to be propagated on
+  // copy assignment.
+  small_vector<T, SmallSize, Allocator>&
+    operator=(const small_vector<T, SmallSize, Allocator>& x) {
+    if (this != &x) {
+      typedef
+        typename alloc_traits::propagate_on_container_copy_assignment
+        propagate;
+      clear();
+      copy_assign_allocator(x, small_vector_bool<propagate::value>());
+      append(x.begin(), x.end());
+    }
+    return *this;
+  }
+
+  allocator_type get_allocator() const {
+    return alloc();
+  }
+
   // iterators:
   iterator begin() {
     return m_begin;
@@ -198,6 +517,26 @@ public:
   bool empty() const {
     return m_begin == m_end;
   }
+  void reserve(size_type n) {
+    note_operation(small_vector_operation::reserve, n);
+    reserve_capacity(n);
+  }
+  // Releases unused heap capacity. If the elements fit in the small
+  // storage, they move back into it and the heap memory is freed.
+  // Otherwise they stay where they are if the allocator says their
+  // block is fixed storage.
+  void shrink_to_fit() {
+    note_operation(small_vector_operation::shrink, size());
+    if (is_small() || size() == capacity()) {
+      return;
+    }
+    if (size() <= SmallSize) {
+      move_to_small();
+    } else if (!small_vector_allocator_fixed_block<allocator_base>::owns(
+                 alloc(), m_begin)) {
+      reallocate(size());
+    }
+  }
 
   // element access:
   reference operator[](size_type n) {
@@ -210,51 +549,110 @@ public:
   // 23.3.6.5, modifiers:
   void push_back(const T& x) {
     // If we do not have enough capacity, reallocate
-    const size_type new_size = size() + 1;
-    if (new_size > capacity()) {
-      // Reallocate a bigger array, but make it still have size()
-      // elements, not size() + 1
-
-      // This could throw bad_alloc
-      const size_type new_capacity = std::max<size_type>(1u, 2 * capacity());
-      T* new_begin = Allocator::allocate(new_capacity);
-
-      // Copy- or move-construct elements. If the constructor throws,
-      // we'll delete our new array and rethrow.
-      // After constructing the new element, we destroy the old one.
-      try {
-        T* old_elem = m_begin;
-        for( T* new_elem = new_begin;
-             old_elem != m_end;
-             ++new_elem, ++old_elem ) {
-          Allocator::construct(new_elem, mymove(*old_elem));
-          Allocator::destroy(old_elem);
-        }
-      } catch (...) {
-        Allocator::deallocate(new_begin, new_capacity);
-        throw;
-      }
+    if (m_end == m_capacity_end) {
+      grow();
+    }
 
-      // Now use the new array and free the old one
-      const size_type old_size = size();
-      T* old_begin = m_begin;
-      const size_type old_capacity = capacity();
-      const bool was_small = is_small();
+    // Now just construct the new element
+    alloc_traits::construct(alloc(), m_end, x);
+    ++m_end;
+    note_operation(small_vector_operation::push_back, size());
+  }
 
-      m_begin = new_begin;
-      m_end = new_begin + old_size;
-      m_capacity_end = new_begin + new_capacity;
+  // Appends the range [first, last) to the end of the vector.
+  // Multi-pass ranges are measured up front so there is at most one
+  // reallocation. Single-pass ranges fill whatever capacity is left
+  // without a capacity check per element, then grow geometrically.
+  template <class InputIterator>
+  void append(InputIterator first, InputIterator last) {
+    typedef
+      typename ::std::iterator_traits<InputIterator>::iterator_category
+      iterator_category;
+    append_range(first, last, iterator_category());
+    note_operation(small_vector_operation::append, size());
+  }
 
-      // Only free memory if it's not from our small backing storage
-      if (!was_small) {
-        Allocator::deallocate(old_begin, old_capacity);
-      }
+  // Same as above, but makes room for size_hint more elements before
+  // appending, growing geometrically if there isn't room already. This is
+  // meant for single-pass ranges whose length is known or can be
+  // estimated; the hint does not have to be exact.
+  template <class InputIterator>
+  void append(InputIterator first, InputIterator last, size_type size_hint) {
+    grow_for(size_hint);
+    append(first, last);
+  }
 
+  // Makes room for n more elements at the end without constructing them,
+  // and returns a pointer to the first of those slots. The caller writes
+  // into [p, p + n) directly and then calls commit() with the number of
+  // slots it actually filled. Slots that are not committed stay
+  // unconstructed. Any other modification of the vector before commit()
+  // discards the reservation.
+  // For types that are not trivially constructible, the caller must
+  // construct objects in the slots (e.g. with placement new) rather than
+  // assign to them.
+  T* grow_uninitialized(size_type n) {
+    grow_for(n);
+    return m_end;
+  }
+
+  // Publishes k elements written after a call to grow_uninitialized(n).
+  // Requires: k <= n
+  void commit(size_type k) {
+    m_end += k;
+    note_operation(small_vector_operation::append, size());
+  }
+
+  // Inserts a copy of x before pos, moving the elements after it up
+  // by one. x may be an element of this vector.
+  iterator insert(iterator pos, const T& x) {
+    const size_type i = pos - m_begin;
+    if (m_end == m_capacity_end) {
+      const T copy(x);
+      grow();
+      return insert_at(m_begin + i, copy);
+    }
+    if (&x >= m_begin + i && &x < m_end) {
+      const T copy(x);
+      return insert_at(m_begin + i, copy);
     }
+    return insert_at(m_begin + i, x);
+  }
 
-    // Now just construct the new element
-    Allocator::construct(m_end, x);
-    ++m_end;
+  // Removes the element at pos, or those in [first, last), moving the
+  // ones after down. Returns where the element after them now is.
+  iterator erase(iterator pos) {
+    return erase(pos, pos + 1);
+  }
+  iterator erase(iterator first, iterator last) {
+    if (first == last) {
+      return first;
+    }
+    note_size();
+    T* to = first;
+    for (T* from = last; from != m_end; ++from, ++to) {
+      *to = mymove(*from);
+    }
+    destroy_range(to, m_end);
+    m_end = to;
+    note_operation(small_vector_operation::erase, size());
+    return first;
+  }
+
+  // Requires: !empty()
+  void pop_back() {
+    note_size();
+    --m_end;
+    alloc_traits::destroy(alloc(), m_end);
+    note_operation(small_vector_operation::erase, size());
+  }
+
+  // Destroys all elements. The capacity is kept.
+  void clear() {
+    note_size();
+    destroy_range(m_begin, m_end);
+    m_end = m_begin;
+    note_operation(small_vector_operation::clear, 0);
   }
 
   // Returns whether we're using our small storage
@@ -265,18 +663,210 @@ private:
    * m_end,
    * m_capacity_end;
 
+#ifdef SMALLVECTOR_STATS
+  static small_vector_stats& stats() {
+    return small_vector_stats::for_type<T, SmallSize>();
+  }
+
+  // Counts constructions, whichever constructor is used, and remembers
+  // whether this vector has ever been on the heap
+  struct stats_tracker {
+    stats_tracker() : spilled(false) { stats().on_construct(); }
+    bool spilled;
+  } m_stats;
+#endif
+
+#ifdef SMALLVECTOR_SITES
+  // The construction site's histogram, and the largest size so far
+  struct site_tracker {
+    explicit site_tracker(const small_vector_site& site) :
+      record(&small_vector_sites::for_site<T, SmallSize>(site)),
+      peak(0) {
+    }
+    small_vector_sites::site_record* record;
+    size_type peak;
+  } m_site;
+#endif
+
+#ifdef SMALLVECTOR_SAMPLING
+  // When a sampled vector was constructed, or 0 if it isn't sampled
+  struct sample_tracker {
+    sample_tracker() :
+      born(small_vector_sampling::sample() ? small_vector_sampling::now()
+                                           : 0) {
+    }
+    ::std::uint64_t born;
+  } m_sample;
+
+  void record_sample(small_vector_sample_event::kind_type kind,
+                     size_type old_capacity, size_type new_capacity,
+                     ::std::uint64_t nanoseconds) const {
+    small_vector_sample_event e;
+    e.kind = kind;
+    e.type = small_vector_sampling::type<T, SmallSize>();
+    e.vector = this;
+    e.old_capacity = old_capacity;
+    e.new_capacity = new_capacity;
+    e.size = size();
+    e.nanoseconds = nanoseconds;
+    small_vector_sampling::record(e);
+  }
+#endif
+
+#ifdef SMALLVECTOR_TRACE
+  // This vector's id in the running trace, or 0 if it isn't traced
+  struct trace_tracker {
+    trace_tracker() : id(small_vector_trace::new_id()) {}
+    ::std::uint32_t id;
+  } m_trace;
+#endif
+
+  // Instrumentation hooks. These compile to nothing unless an
+  // instrumentation mode such as SMALLVECTOR_STATS is enabled.
+
+  // Called at the end of every constructor
+  void note_construct(bool copy) {
+    note_operation(copy ? small_vector_operation::copy
+                        : small_vector_operation::construct, size());
+  }
+
+  // Called after an operation that leaves size elements (or, for
+  // reserve, before asking for a capacity of size)
+  void note_operation(small_vector_operation::type op, size_type size) {
+    (void)op;
+    (void)size;
+#ifdef SMALLVECTOR_TRACE
+    if (m_trace.id && small_vector_trace::recording()) {
+      small_vector_trace::record(m_trace.id, op, size, sizeof(T), SmallSize);
+    }
+#endif
+  }
+
+  // Called after moving moved elements out of storage for old_capacity
+  // elements, which was the small storage if was_small.
+  void note_relocation(size_type old_capacity, bool was_small,
+                       size_type moved) {
+    (void)old_capacity;
+    (void)was_small;
+    (void)moved;
+#ifdef SMALLVECTOR_STATS
+    if (was_small) {
+      stats().on_spill();
+      m_stats.spilled = true;
+    } else {
+      stats().on_reallocate();
+    }
+    stats().on_relocate(moved * sizeof(T));
+#endif
+#ifdef SMALLVECTOR_USDT
+    if (was_small) {
+      SMALLVECTOR_PROBE(spill, old_capacity, capacity(), sizeof(T), 1);
+    } else if (capacity() > old_capacity) {
+      SMALLVECTOR_PROBE(grow, old_capacity, capacity(), sizeof(T), 0);
+    } else {
+      SMALLVECTOR_PROBE(shrink, old_capacity, capacity(), sizeof(T), 0);
+    }
+#endif
+#ifdef SMALLVECTOR_SAMPLING
+    if (m_sample.born) {
+      record_sample(was_small ? small_vector_sample_event::spill
+                              : small_vector_sample_event::grow,
+                    old_capacity, capacity(), 0);
+    }
+#endif
+  }
+
+  // Called before the size goes down
+  void note_size() {
+#ifdef SMALLVECTOR_STATS
+    stats().on_size(size());
+#endif
+#ifdef SMALLVECTOR_SITES
+    m_site.peak = ::std::max(m_site.peak, size());
+#endif
+  }
+
+  void note_destroy() {
+    note_operation(small_vector_operation::destroy, size());
+#ifdef SMALLVECTOR_STATS
+    stats().on_destroy(!m_stats.spilled, size());
+#endif
+#ifdef SMALLVECTOR_SITES
+    m_site.record->on_destroy(::std::max(m_site.peak, size()));
+#endif
+#ifdef SMALLVECTOR_SAMPLING
+    if (m_sample.born) {
+      record_sample(small_vector_sample_event::destroy, capacity(),
+                    capacity(), small_vector_sampling::now() - m_sample.born);
+    }
+#endif
+  }
+
+  allocator_base& alloc() {
+    return *this;
+  }
+  const allocator_base& alloc() const {
+    return *this;
+  }
+
+  // Replaces our allocator with x's. Memory from the old allocator is
+  // freed first, unless the two are interchangeable. Requires: empty()
+  void copy_assign_allocator(const small_vector<T, SmallSize, Allocator>& x,
+                             small_vector_bool<true>) {
+    if (!is_small() && !(alloc() == x.alloc())) {
+      alloc_traits::deallocate(alloc(), m_begin, capacity());
+      m_begin = m_end = storage_base::small_begin();
+      m_capacity_end = storage_base::small_end();
+    }
+    alloc() = x.alloc();
+  }
+  void copy_assign_allocator(const small_vector<T, SmallSize, Allocator>&,
+                             small_vector_bool<false>) {
+  }
+
   // Initializes the range [first, last) to value. Doesn't destruct the
   // range because it assumes that no objects have been constructed there.
   void uninitialized_fill(T* first, T* last, const T& value) {
     for( ; first != last; ++first ) {
-      Allocator::construct(first, value);
+      alloc_traits::construct(alloc(), first, value);
     }
   }
 
+  // Constructs n copies of value in a fresh vector. If n is greater than
+  // the small size, allocate memory first. Otherwise we can use our small
+  // storage.
+  void fill_construct(size_type n, const T& value) {
+    if (n > SmallSize) {
+      size_type count;
+      m_begin = allocate_at_least(n, count);
+      m_capacity_end = m_begin + count;
+      note_relocation(SmallSize, true, 0);
+    }
+    m_end = m_begin + n;
+    uninitialized_fill(m_begin, m_end, value);
+  }
+
+  // Inserts x before p, which is in [m_begin, m_end]. Requires: there
+  // is room for one more element, and x is not in [p, m_end)
+  iterator insert_at(T* p, const T& x) {
+    if (p == m_end) {
+      alloc_traits::construct(alloc(), m_end, x);
+    } else {
+      alloc_traits::construct(alloc(), m_end, mymove(*(m_end - 1)));
+      for (T* to = m_end - 1; to != p; --to) {
+        *to = mymove(*(to - 1));
+      }
+      *p = x;
+    }
+    ++m_end;
+    note_operation(small_vector_operation::insert, size());
+    return p;
+  }
+
   // Destroys the objects in the range [first, last)
   void destroy_range(T* first, T* last) {
     for( ; first != last; ++first ) {
-      Allocator::destroy( first );
+      alloc_traits::destroy(alloc(), first);
     }
   }
 
@@ -286,14 +876,16 @@ private:
     // Allocate space
     const size_type n = ::std::distance(first, last);
     if (n > SmallSize) {
-      m_begin = Allocator::allocate(n);
-      m_capacity_end = m_begin + n;
+      size_type count;
+      m_begin = allocate_at_least(n, count);
+      m_capacity_end = m_begin + count;
+      note_relocation(SmallSize, true, 0);
     }
     m_end = m_begin + n;
 
     // Copy construct the range
     for ( T* elem = m_begin; first != last; ++first, ++elem) {
-      Allocator::construct(elem, *first);
+      alloc_traits::construct(alloc(), elem, *first);
     }
   }
 
@@ -319,9 +911,200 @@ private:
   template <class InputIterator>
   void range_construct(InputIterator first, InputIterator last,
                        ::std::input_iterator_tag) {
-    for( ; first != last; ++first ) {
-      push_back( *first );
+    append_range(first, last, ::std::input_iterator_tag());
+  }
+
+  // Append for multi-pass iterators. We can count the elements first,
+  // so grow once, geometrically, and construct in place. The range may
+  // be part of this vector.
+  template <class ForwardIterator>
+  void append_range(ForwardIterator first, ForwardIterator last,
+                    ::std::forward_iterator_tag) {
+    const size_type n = ::std::distance(first, last);
+    if (n > static_cast<size_type>(m_capacity_end - m_end)) {
+      const T* const old_begin = m_begin;
+      const T* const old_end = m_end;
+      grow_for(n);
+      rebase_range(first, last, old_begin, old_end);
+    }
+    for ( ; first != last; ++first, ++m_end) {
+      alloc_traits::construct(alloc(), m_end, *first);
+    }
+  }
+
+  // After a reallocation, points a range that was in the old elements
+  // [old_begin, old_end) at the same elements in the new array. Only
+  // pointers can refer to the elements, so other iterators are left as
+  // they are.
+  template <class Iterator>
+  void rebase_range(Iterator&, Iterator&, const T*, const T*) {
+  }
+  void rebase_range(const T*& first, const T*& last,
+                    const T* old_begin, const T* old_end) {
+    if (first >= old_begin && first < old_end) {
+      last = m_begin + (last - old_begin);
+      first = m_begin + (first - old_begin);
+    }
+  }
+  void rebase_range(T*& first, T*& last,
+                    const T* old_begin, const T* old_end) {
+    if (first >= old_begin && first < old_end) {
+      last = m_begin + (last - old_begin);
+      first = m_begin + (first - old_begin);
+    }
+  }
+
+  // Append for single-pass iterators. Fill the capacity we already have
+  // in a tight loop, and only check for growth once it runs out.
+  template <class InputIterator>
+  void append_range(InputIterator first, InputIterator last,
+                    ::std::input_iterator_tag) {
+    while (first != last) {
+      if (m_end == m_capacity_end) {
+        grow();
+      }
+      for ( ; first != last && m_end != m_capacity_end; ++first, ++m_end) {
+        alloc_traits::construct(alloc(), m_end, *first);
+      }
+    }
+  }
+
+  // Grows the capacity geometrically to make room for at least one
+  // more element.
+  void grow() {
+    reallocate(std::max<size_type>(1u, 2 * capacity()));
+  }
+
+  // Makes room for n more elements, growing to at least twice the
+  // capacity if there isn't room already, so that repeated appends
+  // reallocate a logarithmic number of times.
+  void grow_for(size_type n) {
+    if (n > static_cast<size_type>(m_capacity_end - m_end)) {
+      reserve_capacity(std::max<size_type>(size() + n, 2 * capacity()));
+    }
+  }
+
+  // reserve() without the trace record, for growth the user didn't ask
+  // for explicitly, which a replay with other settings would redo its
+  // own way
+  void reserve_capacity(size_type n) {
+    if (n > capacity()) {
+      reallocate(n);
+    }
+  }
+
+  // Moves the elements into a new array of new_capacity elements, which
+  // must be at least size().
+  void reallocate(size_type new_capacity) {
+    const bool use_allocator =
+      small_vector_trivially_relocatable<T>::value &&
+      small_vector_can_reallocate<allocator_base>::value;
+    if (!is_small()) {
+      heap_reallocate(alloc(), new_capacity,
+                      small_vector_bool<use_allocator>());
+      return;
     }
+
+    // This could throw bad_alloc
+    T* new_begin = allocate_at_least(new_capacity, new_capacity);
+    move_elements(new_begin, new_capacity);
+  }
+
+  // Let the allocator move heap memory itself, e.g. with realloc or mremap.
+  // These overloads, like allocate_at_least's, are templates on the
+  // allocator so that an explicit instantiation of small_vector only
+  // compiles the one that is called.
+  template <class A>
+  void heap_reallocate(A& a, size_type new_capacity,
+                       small_vector_bool<true>) {
+    const size_type old_size = size();
+    const size_type old_capacity = capacity();
+    m_begin = a.reallocate(m_begin, old_capacity, new_capacity);
+    m_end = m_begin + old_size;
+    m_capacity_end = m_begin + new_capacity;
+    note_relocation(old_capacity, false, old_size);
+  }
+
+  template <class A>
+  void heap_reallocate(A&, size_type new_capacity,
+                       small_vector_bool<false>) {
+    // This could throw bad_alloc
+    T* new_begin = allocate_at_least(new_capacity, new_capacity);
+    move_elements(new_begin, new_capacity);
+  }
+
+  // Allocates room for at least n elements, and sets count to how many
+  // there is room for
+  T* allocate_at_least(size_type n, size_type& count) {
+    return allocate_at_least(
+      alloc(), n, count,
+      small_vector_bool<
+        small_vector_can_allocate_at_least<allocator_base>::value>());
+  }
+  template <class A>
+  static T* allocate_at_least(A& a, size_type n, size_type& count,
+                              small_vector_bool<true>) {
+    return a.allocate_at_least(n, count);
+  }
+  template <class A>
+  static T* allocate_at_least(A& a, size_type n, size_type& count,
+                              small_vector_bool<false>) {
+    count = n;
+    return alloc_traits::allocate(a, n);
+  }
+
+  // Moves the elements back into the small storage and frees the heap
+  // array. Requires: !is_small() && size() <= SmallSize
+  void move_to_small() {
+    T* const small = storage_base::small_begin();
+    const size_type old_size = size();
+    const size_type old_capacity = capacity();
+    T* old_elem = m_begin;
+    for (T* new_elem = small; old_elem != m_end; ++new_elem, ++old_elem) {
+      alloc_traits::construct(alloc(), new_elem, mymove(*old_elem));
+      alloc_traits::destroy(alloc(), old_elem);
+    }
+    alloc_traits::deallocate(alloc(), m_begin, old_capacity);
+    m_begin = small;
+    m_end = small + old_size;
+    m_capacity_end = storage_base::small_end();
+    note_relocation(old_capacity, false, old_size);
+  }
+
+  // Moves the elements into new_begin, an array of new_capacity elements
+  // from the allocator, and frees the old array.
+  void move_elements(T* new_begin, size_type new_capacity) {
+    // Copy- or move-construct elements. If the constructor throws,
+    // we'll delete our new array and rethrow.
+    // After constructing the new element, we destroy the old one.
+    try {
+      T* old_elem = m_begin;
+      for( T* new_elem = new_begin;
+           old_elem != m_end;
+           ++new_elem, ++old_elem ) {
+        alloc_traits::construct(alloc(), new_elem, mymove(*old_elem));
+        alloc_traits::destroy(alloc(), old_elem);
+      }
+    } catch (...) {
+      alloc_traits::deallocate(alloc(), new_begin, new_capacity);
+      throw;
+    }
+
+    // Now use the new array and free the old one
+    const size_type old_size = size();
+    T* old_begin = m_begin;
+    const size_type old_capacity = capacity();
+    const bool was_small = is_small();
+
+    m_begin = new_begin;
+    m_end = new_begin + old_size;
+    m_capacity_end = new_begin + new_capacity;
+
+    // Only free memory if it's not from our small backing storage
+    if (!was_small) {
+      alloc_traits::deallocate(alloc(), old_begin, old_capacity);
+    }
+    note_relocation(old_capacity, was_small, old_size);
   }
 
   // For C++03 compatibility, define move as a no-op if it's unsupported.
@@ -332,3 +1115,49 @@ private:
 #endif
 };
 
+#undef SMALLVECTOR_SITE_PARAM
+#undef SMALLVECTOR_SITE_INIT
+
+// Explicit instantiation. SMALLVECTOR_DECLARE_INSTANTIATION(T, N), at
+// namespace scope after this header, stops small_vector<T, N> from
+// being instantiated in that translation unit; one translation unit
+// must then have SMALLVECTOR_DEFINE_INSTANTIATION(T, N) instead. Both
+// must see the same SMALLVECTOR_* modes.
+//
+// With SMALLVECTOR_EXTERN_TEMPLATES defined, this header declares the
+// common specializations below, and small_vector_instantiations.cpp
+// must be linked in. Declarations need C++11, so before that this only
+// links the instantiations, and every translation unit still does its
+// own.
+#if __cplusplus >= 201103L
+#define SMALLVECTOR_DECLARE_INSTANTIATION(T, N) \
+  extern template class small_vector<T, N>;
+#else
+#define SMALLVECTOR_DECLARE_INSTANTIATION(T, N)
+#endif
+#define SMALLVECTOR_DEFINE_INSTANTIATION(T, N) \
+  template class small_vector<T, N>;
+
+#define SMALLVECTOR_FOR_EACH_COMMON_INSTANTIATION(X) \
+  X(char, 16) X(char, 32)                            \
+  X(int, 4) X(int, 8) X(int, 16)                     \
+  X(unsigned, 4) X(unsigned, 8) X(unsigned, 16)      \
+  X(double, 4) X(double, 8)                          \
+  X(void*, 4) X(void*, 8)
+
+#ifdef SMALLVECTOR_EXTERN_TEMPLATES
+SMALLVECTOR_FOR_EACH_COMMON_INSTANTIATION(SMALLVECTOR_DECLARE_INSTANTIATION)
+#endif
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+
+namespace pmr {
+  // A small_vector whose heap storage comes from a std::pmr::memory_resource
+  template <class T, ::std::size_t SmallSize>
+  using small_vector =
+    ::small_vector<T, SmallSize, ::std::pmr::polymorphic_allocator<T> >;
+}
+#endif
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+// Readable element type names for the reports of the SMALLVECTOR_STATS,
+// SMALLVECTOR_SITES and SMALLVECTOR_SAMPLING modes, which include this
+// header themselves.
+
+#include <typeinfo>     // std::type_info
+#if defined(__GNUG__)
+#include <cxxabi.h>     // abi::__cxa_demangle
+#endif
+
+// The demangled name of type, or its raw name if that fails. Never
+// freed: the reports read the names at exit, after everything else.
+inline const char* small_vector_demangle(const ::std::type_info& type) {
+#if defined(__GNUG__)
+  int status = 0;
+  char* name = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+  if (status == 0 && name) {
+    return name;
+  }
+#endif
+  return type.name();
+}
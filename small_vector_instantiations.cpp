@@ -0,0 +1,10 @@
+// Instantiates the common small_vector specializations once, for
+// programs built with SMALLVECTOR_EXTERN_TEMPLATES; see small_vector.h.
+// Build it with the same SMALLVECTOR_* modes as the rest of the program.
+
+#ifndef SMALLVECTOR_EXTERN_TEMPLATES
+#define SMALLVECTOR_EXTERN_TEMPLATES
+#endif
+#include "small_vector.h"
+
+SMALLVECTOR_FOR_EACH_COMMON_INSTANTIATION(SMALLVECTOR_DEFINE_INSTANTIATION)
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "small_vector.h"
+
+#include <cerrno>       // errno, EINTR
+#include <climits>      // IOV_MAX
+#include <cstddef>      // std::size_t
+#include <sys/types.h>  // ssize_t, off_t
+#include <sys/uio.h>    // iovec, writev
+#include <unistd.h>     // read, pread
+
+// POSIX helpers that read into and write out of small_vectors of bytes
+// without going through an intermediate buffer.
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Only byte vectors can be filled straight from a file descriptor.
+// Other element types fail to compile.
+template <class T> struct small_vector_io_byte;
+template <> struct small_vector_io_byte<char> {};
+template <> struct small_vector_io_byte<signed char> {};
+template <> struct small_vector_io_byte<unsigned char> {};
+
+// Reads up to max bytes from fd and appends them to the end of vec.
+// Returns the number of bytes appended, 0 at end of file, or -1 with
+// errno set. Interrupted reads are retried. On error vec is unchanged.
+template <class T, ::std::size_t SmallSize, class Allocator>
+ssize_t read_append(small_vector<T, SmallSize, Allocator>& vec,
+                    int fd, ::std::size_t max) {
+  (void)sizeof(small_vector_io_byte<T>);
+  T* tail = vec.grow_uninitialized(max);
+  ssize_t n;
+  do {
+    n = ::read(fd, tail, max);
+  } while (n < 0 && errno == EINTR);
+  if (n > 0) {
+    vec.commit(n);
+  }
+  return n;
+}
+
+// Same as read_append, but reads at offset without moving the file
+// position.
+template <class T, ::std::size_t SmallSize, class Allocator>
+ssize_t pread_append(small_vector<T, SmallSize, Allocator>& vec,
+                     int fd, ::std::size_t max, off_t offset) {
+  (void)sizeof(small_vector_io_byte<T>);
+  T* tail = vec.grow_uninitialized(max);
+  ssize_t n;
+  do {
+    n = ::pread(fd, tail, max, offset);
+  } while (n < 0 && errno == EINTR);
+  if (n > 0) {
+    vec.commit(n);
+  }
+  return n;
+}
+
+// Collects the contents of several vectors into an iovec array so that
+// they can be written with a single writev call. Only pointers to the
+// data are kept, so the vectors must outlive the gather and must not be
+// modified until it has been written.
+template < ::std::size_t SmallSize = 8>
+class iovec_gather {
+public:
+  iovec_gather() : m_next(0) {}
+
+  template <class T, ::std::size_t N, class Allocator>
+  void add(const small_vector<T, N, Allocator>& vec) {
+    add(vec.begin(), vec.size() * sizeof(T));
+  }
+
+  void add(const void* data, ::std::size_t len) {
+    if (len == 0) {
+      return;
+    }
+    iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = len;
+    m_iovecs.push_back(iov);
+  }
+
+  // The buffers not yet completely written, the first of them trimmed
+  // to its unwritten part. size() is 0 once everything is out.
+  ::std::size_t size() const { return m_iovecs.size() - m_next; }
+  const iovec* data() const { return m_iovecs.begin() + m_next; }
+
+  // Writes everything that was added to fd, issuing as few writev calls
+  // as partial writes and IOV_MAX allow. Interrupted writes are retried.
+  // Like write(2), returns the number of bytes written by this call, or
+  // -1 with errno set if an error such as EAGAIN came before any were;
+  // an error after some bytes went out ends the call early, and size()
+  // is then not 0. The gather is consumed as data goes out, so calling
+  // write_all again continues with the unwritten rest.
+  ssize_t write_all(int fd) {
+    ssize_t total = 0;
+    iovec* first = m_iovecs.begin() + m_next;
+    iovec* last = m_iovecs.end();
+    while (first != last) {
+      const int count = last - first < IOV_MAX ?
+                        static_cast<int>(last - first) : IOV_MAX;
+      const ssize_t n = ::writev(fd, first, count);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        m_next = first - m_iovecs.begin();
+        return total > 0 ? total : -1;
+      }
+      total += n;
+
+      // Skip over what was written, trimming a partially written buffer
+      ::std::size_t written = n;
+      while (first != last && written >= first->iov_len) {
+        written -= first->iov_len;
+        ++first;
+      }
+      if (written > 0) {
+        first->iov_base = static_cast<char*>(first->iov_base) + written;
+        first->iov_len -= written;
+      }
+    }
+    m_next = m_iovecs.size();
+    return total;
+  }
+
+private:
+  small_vector<iovec, SmallSize> m_iovecs;
+  // Index of the first buffer that has not been completely written
+  ::std::size_t m_next;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+// Static tracepoints for small_vector, enabled by building with
+// SMALLVECTOR_USDT defined. small_vector.h includes this header itself
+// in that case. Each probe is a single nop in the code, plus an ELF note
+// in the same format as <sys/sdt.h>'s, so perf, bpftrace and SystemTap
+// can attach to it without any library or runtime support:
+//
+//   bpftrace -e 'usdt:./binary:small_vector:spill { @[ustack] = count(); }'
+//
+// Provider small_vector has three probes: spill (the small storage to
+// the heap), grow (the heap to a bigger buffer) and shrink (to a smaller
+// buffer, or back to the small storage). Each has four 64-bit unsigned
+// arguments: the old capacity, the new capacity, sizeof(T), and 1 if
+// the move was from the small storage to the heap, else 0.
+//
+// Only x86-64 ELF targets are supported; elsewhere the probes compile to
+// nothing.
+
+#if defined(__x86_64__) && defined(__ELF__)
+
+// A probe site: a nop whose address, and the locations of the four
+// arguments at that point, are recorded in a .note.stapsdt entry
+#define SMALLVECTOR_PROBE(name, arg1, arg2, arg3, arg4)                   \
+  __asm__ __volatile__(                                                   \
+    "990: nop\n"                                                          \
+    ".pushsection .note.stapsdt,\"\",\"note\"\n"                          \
+    ".balign 4\n"                                                         \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                    \
+    "991: .asciz \"stapsdt\"\n"                                           \
+    "992: .balign 4\n"                                                    \
+    "993: .8byte 990b\n"                                                  \
+    ".8byte _.stapsdt.base\n"                                             \
+    ".8byte 0\n"                                                          \
+    ".asciz \"small_vector\"\n"                                           \
+    ".asciz \"" #name "\"\n"                                              \
+    ".asciz \"8@%0 8@%1 8@%2 8@%3\"\n"                                    \
+    "994: .balign 4\n"                                                    \
+    ".popsection\n"                                                       \
+    ".ifndef _.stapsdt.base\n"                                            \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n"                                              \
+    ".hidden _.stapsdt.base\n"                                            \
+    "_.stapsdt.base: .space 1\n"                                          \
+    ".size _.stapsdt.base, 1\n"                                           \
+    ".popsection\n"                                                       \
+    ".endif\n"                                                            \
+    :                                                                     \
+    : "nor"(static_cast<unsigned long>(arg1)),                            \
+      "nor"(static_cast<unsigned long>(arg2)),                            \
+      "nor"(static_cast<unsigned long>(arg3)),                            \
+      "nor"(static_cast<unsigned long>(arg4)))
+
+#else
+
+#define SMALLVECTOR_PROBE(name, arg1, arg2, arg3, arg4)                   \
+  do {                                                                    \
+    (void)(arg1);                                                         \
+    (void)(arg2);                                                         \
+    (void)(arg3);                                                         \
+    (void)(arg4);                                                         \
+  } while (false)
+
+#endif
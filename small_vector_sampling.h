@@ -0,0 +1,309 @@
+#pragma once
+
+// Sampled instrumentation for small_vector, cheap enough to leave on in
+// production. Enabled by building with SMALLVECTOR_SAMPLING defined;
+// small_vector.h includes this header itself in that case.
+//
+// One in every sample_period() small_vectors constructed on a thread is
+// sampled, picked by a thread-local countdown. Sampled vectors record
+// their spills, later growth steps, and their lifetime and final size
+// at destruction, as events in a buffer belonging to the recording
+// thread. Everything else pays one well-predicted branch per hook.
+//
+// The per-thread buffers are single-producer, single-consumer rings:
+// the thread writes, and drain() reads, without locks. When a ring is
+// full, new events are dropped and counted. A small_vector_sample_reporter
+// drains them periodically from its own thread; drain() and report() can
+// also be called directly. Nothing is printed unless asked for.
+
+#if __cplusplus < 201103L
+#error "SMALLVECTOR_SAMPLING requires C++11"
+#endif
+
+#include "small_vector_demangle.h"
+
+#include <atomic>               // std::atomic
+#include <chrono>               // std::chrono::steady_clock
+#include <condition_variable>   // std::condition_variable
+#include <cstddef>              // std::size_t
+#include <cstdint>              // std::uint64_t
+#include <cstdio>               // std::FILE, std::fprintf
+#include <map>                  // std::map
+#include <mutex>                // std::mutex, std::lock_guard
+#include <thread>               // std::thread
+#include <typeinfo>             // typeid
+
+// Which small_vector<T, SmallSize> an event is about
+struct small_vector_sample_type {
+  const char* element_type;
+  ::std::size_t element_size;
+  ::std::size_t small_size;
+};
+
+struct small_vector_sample_event {
+  enum kind_type {
+    spill,      // Moved from the small storage to the heap
+    grow,       // Moved from the heap to a bigger or smaller buffer
+    destroy     // Destroyed; nanoseconds is the vector's lifetime
+  };
+  kind_type kind;
+  const small_vector_sample_type* type;
+  const void* vector;
+  ::std::size_t old_capacity;
+  ::std::size_t new_capacity;
+  ::std::size_t size;
+  ::std::uint64_t nanoseconds;
+};
+
+class small_vector_sampling {
+public:
+  typedef small_vector_sample_event event;
+  typedef unsigned long long counter_type;
+
+  // Events each thread can hold between drains
+  static const ::std::size_t buffer_capacity = 1024;
+
+  // What drain() has collected for one instantiation
+  struct totals {
+    totals() :
+      sampled(0), spills(0), grow_steps(0), lifetime_ns(0), peak_size(0) {}
+    counter_type sampled;       // Sampled vectors destroyed
+    counter_type spills;
+    counter_type grow_steps;
+    counter_type lifetime_ns;   // Summed over the sampled vectors
+    ::std::size_t peak_size;    // Largest size at destruction
+  };
+
+  // 1 in how many vectors is sampled. At least 1.
+  static unsigned sample_period() { return period().load(); }
+  static void set_sample_period(unsigned k) { period().store(k ? k : 1); }
+
+  // Whether to sample the vector being constructed on this thread
+  static bool sample() {
+    unsigned& countdown = local_countdown();
+    if (__builtin_expect(--countdown != 0, 1)) {
+      return false;
+    }
+    countdown = sample_period();
+    return true;
+  }
+
+  static ::std::uint64_t now() {
+    return ::std::chrono::duration_cast< ::std::chrono::nanoseconds>(
+      ::std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  template <class T, ::std::size_t SmallSize>
+  static const small_vector_sample_type* type() {
+    static const small_vector_sample_type t = {
+      small_vector_demangle(typeid(T)), sizeof(T), SmallSize
+    };
+    return &t;
+  }
+
+  // Appends an event to this thread's buffer, or drops it if full
+  static void record(const event& e) {
+    buffer& b = local_buffer();
+    const ::std::size_t head = b.head.load(::std::memory_order_relaxed);
+    if (head - b.tail.load(::std::memory_order_acquire) == buffer_capacity) {
+      b.dropped.fetch_add(1, ::std::memory_order_relaxed);
+      return;
+    }
+    b.events[head % buffer_capacity] = e;
+    b.head.store(head + 1, ::std::memory_order_release);
+  }
+
+  // Moves every thread's pending events into the totals, and returns
+  // how many there were
+  static ::std::size_t drain() {
+    collector& c = get_collector();
+    ::std::lock_guard< ::std::mutex> lock(c.mutex);
+    ::std::size_t n = 0;
+    for (buffer* b = buffers().load(); b; b = b->next) {
+      const ::std::size_t head = b->head.load(::std::memory_order_acquire);
+      ::std::size_t tail = b->tail.load(::std::memory_order_relaxed);
+      for ( ; tail != head; ++tail, ++n) {
+        add(c.by_type[b->events[tail % buffer_capacity].type],
+            b->events[tail % buffer_capacity]);
+      }
+      b->tail.store(tail, ::std::memory_order_release);
+    }
+    return n;
+  }
+
+  // The totals for small_vector<T, SmallSize> as of the last drain()
+  template <class T, ::std::size_t SmallSize>
+  static totals totals_for() {
+    collector& c = get_collector();
+    ::std::lock_guard< ::std::mutex> lock(c.mutex);
+    return c.by_type[type<T, SmallSize>()];
+  }
+
+  // Events dropped because a thread's buffer was full
+  static counter_type dropped() {
+    counter_type n = 0;
+    for (buffer* b = buffers().load(); b; b = b->next) {
+      n += b->dropped.load(::std::memory_order_relaxed);
+    }
+    return n;
+  }
+
+  // Drains, then writes a line per instantiation to out. Estimated
+  // totals are the sampled counts scaled by the current sample period.
+  static void report(::std::FILE* out) {
+    drain();
+    collector& c = get_collector();
+    ::std::lock_guard< ::std::mutex> lock(c.mutex);
+    ::std::fprintf(out, "%-32s %6s %6s %10s %12s %8s %10s %12s %10s\n",
+                   "small_vector<T, N>", "N", "sizeof", "sampled",
+                   "est. total", "spilled", "grows/vec", "lifetime us",
+                   "peak size");
+    for (::std::map<const small_vector_sample_type*, totals>::const_iterator
+           i = c.by_type.begin(); i != c.by_type.end(); ++i) {
+      const totals& t = i->second;
+      if (!t.sampled) {
+        continue;
+      }
+      ::std::fprintf(out, "%-32s %6zu %6zu %10llu %12llu %7.1f%% %10.2f "
+                     "%12.2f %10zu\n",
+                     i->first->element_type, i->first->small_size,
+                     i->first->element_size, t.sampled,
+                     t.sampled * sample_period(),
+                     100.0 * t.spills / t.sampled,
+                     double(t.grow_steps) / t.sampled,
+                     t.lifetime_ns / 1000.0 / t.sampled, t.peak_size);
+    }
+    if (counter_type n = dropped()) {
+      ::std::fprintf(out, "%llu events dropped\n", n);
+    }
+  }
+
+private:
+  // Written only by the owning thread (head) and drain() (tail)
+  struct buffer {
+    buffer() : in_use(true), head(0), tail(0), dropped(0), next(NULL) {}
+    ::std::atomic<bool> in_use;
+    ::std::atomic< ::std::size_t> head;
+    ::std::atomic< ::std::size_t> tail;
+    ::std::atomic<counter_type> dropped;
+    event events[buffer_capacity];
+    buffer* next;
+  };
+
+  // Buffers are never freed. A thread that exits gives its buffer back,
+  // and the next new thread takes it over, so there are only ever as
+  // many as there were threads recording at once.
+  struct buffer_handle {
+    buffer_handle() : b(acquire()) {}
+    ~buffer_handle() { b->in_use.store(false, ::std::memory_order_release); }
+    buffer* b;
+  };
+
+  struct collector {
+    ::std::mutex mutex;
+    ::std::map<const small_vector_sample_type*, totals> by_type;
+  };
+
+  static ::std::atomic<unsigned>& period() {
+    static ::std::atomic<unsigned> k(1024);
+    return k;
+  }
+
+  static unsigned& local_countdown() {
+    // Starts at 1, so each thread samples its first vector
+    static thread_local unsigned countdown = 1;
+    return countdown;
+  }
+
+  static ::std::atomic<buffer*>& buffers() {
+    static ::std::atomic<buffer*> head(NULL);
+    return head;
+  }
+
+  static buffer& local_buffer() {
+    static thread_local buffer_handle handle;
+    return *handle.b;
+  }
+
+  static buffer* acquire() {
+    for (buffer* b = buffers().load(); b; b = b->next) {
+      bool free = false;
+      if (!b->in_use.load(::std::memory_order_relaxed) &&
+          b->in_use.compare_exchange_strong(free, true,
+                                            ::std::memory_order_acquire)) {
+        return b;
+      }
+    }
+    buffer* b = new buffer;
+    b->next = buffers().load();
+    while (!buffers().compare_exchange_weak(b->next, b)) {
+    }
+    return b;
+  }
+
+  // Lives until exit, so that threads may still record during static
+  // destruction
+  static collector& get_collector() {
+    static collector* c = new collector;
+    return *c;
+  }
+
+  static void add(totals& t, const event& e) {
+    switch (e.kind) {
+    case event::spill:
+      ++t.spills;
+      break;
+    case event::grow:
+      ++t.grow_steps;
+      break;
+    case event::destroy:
+      ++t.sampled;
+      t.lifetime_ns += e.nanoseconds;
+      if (e.size > t.peak_size) {
+        t.peak_size = e.size;
+      }
+      break;
+    }
+  }
+};
+
+// Drains the sample buffers every interval on a thread of its own, and
+// once more when destroyed
+class small_vector_sample_reporter {
+public:
+  explicit small_vector_sample_reporter(
+      ::std::chrono::milliseconds interval = ::std::chrono::milliseconds(100)) :
+    m_interval(interval),
+    m_stop(false),
+    m_thread(&small_vector_sample_reporter::run, this) {
+  }
+
+  ~small_vector_sample_reporter() {
+    {
+      ::std::lock_guard< ::std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+    small_vector_sampling::drain();
+  }
+
+private:
+  void run() {
+    ::std::unique_lock< ::std::mutex> lock(m_mutex);
+    while (!m_wake.wait_for(lock, m_interval, [this] { return m_stop; })) {
+      lock.unlock();
+      small_vector_sampling::drain();
+      lock.lock();
+    }
+  }
+
+  ::std::chrono::milliseconds m_interval;
+  ::std::mutex m_mutex;
+  ::std::condition_variable m_wake;
+  bool m_stop;
+  ::std::thread m_thread;
+
+  small_vector_sample_reporter(const small_vector_sample_reporter&);
+  small_vector_sample_reporter& operator=(const small_vector_sample_reporter&);
+};
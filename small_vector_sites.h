@@ -0,0 +1,277 @@
+#pragma once
+
+// Per-call-site size histograms for small_vector, enabled by building
+// with SMALLVECTOR_SITES defined. small_vector.h includes this header
+// itself in that case, and every small_vector constructor takes an extra
+// defaulted argument recording the file and line it was called from.
+//
+// When a vector is destroyed, the largest size it reached goes into a
+// log2 histogram for its construction site. report() then prints, for
+// each site, how many of its vectors outgrew SmallSize, and which
+// SmallSize would have kept 90% and 99% of them inline, along with what
+// that costs in inline bytes per vector. It is written to stderr at exit
+// unless small_vector_sites::report_at_exit(false) is called.
+//
+// Needs __builtin_FILE and __builtin_LINE (GCC 4.8 or Clang 9 on).
+
+#if __cplusplus < 201103L
+#error "SMALLVECTOR_SITES requires C++11"
+#endif
+
+#include "small_vector_demangle.h"
+
+#include <algorithm>    // std::sort
+#include <atomic>       // std::atomic
+#include <cstddef>      // std::size_t
+#include <cstdio>       // std::FILE, std::fprintf
+#include <cstdlib>      // std::atexit
+#include <cstring>      // std::strcmp
+#include <map>          // std::map
+#include <mutex>        // std::mutex, std::lock_guard
+#include <typeinfo>     // typeid
+#include <vector>       // std::vector
+
+// Where a small_vector was constructed. As a default argument, current()
+// picks up the caller's file and line.
+struct small_vector_site {
+  const char* file;
+  unsigned line;
+
+  static small_vector_site current(const char* file = __builtin_FILE(),
+                                   unsigned line = __builtin_LINE()) {
+    small_vector_site site;
+    site.file = file;
+    site.line = line;
+    return site;
+  }
+};
+
+class small_vector_sites {
+public:
+  typedef unsigned long long counter_type;
+
+  // Bucket 0 holds vectors that stayed empty, bucket k > 0 those whose
+  // largest size was in (bucket_limit(k - 1), bucket_limit(k)]
+  static const ::std::size_t buckets = 8 * sizeof(::std::size_t) + 1;
+
+  static ::std::size_t bucket_of(::std::size_t size) {
+    ::std::size_t k = 1;
+    while (bucket_limit(k) < size) {
+      ++k;
+    }
+    return size ? k : 0;
+  }
+
+  static ::std::size_t bucket_limit(::std::size_t k) {
+    return k ? ::std::size_t(1) << (k - 1) : 0;
+  }
+
+  // The histogram for one small_vector<T, SmallSize> construction site
+  class site_record {
+  public:
+    const char* file() const { return m_file; }
+    unsigned line() const { return m_line; }
+    const char* element_type() const { return m_element_type; }
+    ::std::size_t element_size() const { return m_element_size; }
+    ::std::size_t small_size() const { return m_small_size; }
+
+    // Vectors from this site destroyed so far
+    counter_type vectors() const { return m_vectors.load(); }
+    // Of those, how many grew past SmallSize
+    counter_type spilled() const { return m_spilled.load(); }
+    counter_type bucket(::std::size_t k) const { return m_buckets[k].load(); }
+
+    // The smallest bucket limit that at least fraction of the vectors
+    // stayed within, i.e. a SmallSize that would have kept them inline
+    ::std::size_t size_covering(double fraction) const {
+      const counter_type total = vectors();
+      counter_type covered = 0;
+      for (::std::size_t k=0; k<buckets; ++k) {
+        covered += bucket(k);
+        if (covered >= fraction * total) {
+          return bucket_limit(k);
+        }
+      }
+      return bucket_limit(buckets - 1);
+    }
+
+    // The next site, or NULL
+    const site_record* next() const { return m_next; }
+
+    // Called by small_vector
+    void on_destroy(::std::size_t max_size) {
+      ++m_vectors;
+      if (max_size > m_small_size) {
+        ++m_spilled;
+      }
+      ++m_buckets[bucket_of(max_size)];
+    }
+
+  private:
+    friend class small_vector_sites;
+
+    site_record(const small_vector_site& site, const char* element_type,
+                ::std::size_t element_size, ::std::size_t small_size) :
+      m_file(site.file),
+      m_line(site.line),
+      m_element_type(element_type),
+      m_element_size(element_size),
+      m_small_size(small_size),
+      m_vectors(0),
+      m_spilled(0),
+      m_next(NULL) {
+      for (::std::size_t k=0; k<buckets; ++k) {
+        m_buckets[k] = 0;
+      }
+    }
+
+    const char* m_file;
+    unsigned m_line;
+    const char* m_element_type;
+    ::std::size_t m_element_size;
+    ::std::size_t m_small_size;
+    ::std::atomic<counter_type> m_vectors;
+    ::std::atomic<counter_type> m_spilled;
+    ::std::atomic<counter_type> m_buckets[buckets];
+    site_record* m_next;
+
+    site_record(const site_record&);
+    site_record& operator=(const site_record&);
+  };
+
+  // Every site seen so far, most recent first
+  static const site_record* first() { return registry().head.load(); }
+
+  // The record for small_vector<T, SmallSize>s constructed at site
+  template <class T, ::std::size_t SmallSize>
+  static site_record& for_site(const small_vector_site& site) {
+    // Each thread remembers its last few lookups, so that a loop
+    // constructing vectors doesn't take the lock every time
+    static thread_local cache_entry cache[cache_size];
+    cache_entry& entry = cache[site.line % cache_size];
+    if (entry.record && entry.file == site.file && entry.line == site.line) {
+      return *entry.record;
+    }
+    static const char* const element_type = small_vector_demangle(typeid(T));
+    site_record& record = find_or_add(element_type, sizeof(T), SmallSize,
+                                      site);
+    entry.file = site.file;
+    entry.line = site.line;
+    entry.record = &record;
+    return record;
+  }
+
+  // Writes a line per site to out, busiest first, each followed by its
+  // histogram as "largest size <= limit: vectors" pairs
+  static void report(::std::FILE* out) {
+    ::std::vector<const site_record*> sites;
+    for (const site_record* s = first(); s; s = s->next()) {
+      if (s->vectors()) {
+        sites.push_back(s);
+      }
+    }
+    ::std::sort(sites.begin(), sites.end(), busier);
+
+    ::std::fprintf(out, "%-40s %-20s %6s %6s %10s %8s %6s %6s %10s %10s "
+                   "%10s\n",
+                   "site", "T", "sizeof", "N", "vectors", "spilled",
+                   "p90 N", "p99 N", "bytes@N", "bytes@p90", "bytes@p99");
+    for (::std::size_t i=0; i<sites.size(); ++i) {
+      const site_record& s = *sites[i];
+      const ::std::size_t p90 = s.size_covering(0.90);
+      const ::std::size_t p99 = s.size_covering(0.99);
+      char where[256];
+      ::std::snprintf(where, sizeof(where), "%s:%u", s.file(), s.line());
+      ::std::fprintf(out, "%-40s %-20s %6zu %6zu %10llu %7.1f%% %6zu %6zu "
+                     "%10zu %10zu %10zu\n",
+                     where, s.element_type(), s.element_size(),
+                     s.small_size(), s.vectors(),
+                     100.0 * s.spilled() / s.vectors(), p90, p99,
+                     s.small_size() * s.element_size(),
+                     p90 * s.element_size(), p99 * s.element_size());
+      ::std::fprintf(out, "  ");
+      for (::std::size_t k=0; k<buckets; ++k) {
+        if (s.bucket(k)) {
+          ::std::fprintf(out, " <=%zu:%llu", bucket_limit(k), s.bucket(k));
+        }
+      }
+      ::std::fprintf(out, "\n");
+    }
+  }
+
+  // Whether to report() to stderr at exit. On by default.
+  static void report_at_exit(bool enable) { registry().at_exit = enable; }
+
+private:
+  struct cache_entry {
+    const char* file;
+    unsigned line;
+    site_record* record;
+  };
+  static const ::std::size_t cache_size = 64;
+
+  // Sites are told apart by file name rather than by pointer, since each
+  // translation unit may have its own copy of the string
+  struct site_key {
+    const char* element_type;
+    ::std::size_t small_size;
+    const char* file;
+    unsigned line;
+
+    bool operator<(const site_key& rhs) const {
+      if (element_type != rhs.element_type) {
+        return element_type < rhs.element_type;
+      }
+      if (small_size != rhs.small_size) {
+        return small_size < rhs.small_size;
+      }
+      if (line != rhs.line) {
+        return line < rhs.line;
+      }
+      return ::std::strcmp(file, rhs.file) < 0;
+    }
+  };
+
+  // Records are never freed: they have to outlive the exit-time report
+  struct site_registry {
+    site_registry() : head(NULL), at_exit(true) {}
+    ::std::mutex mutex;
+    ::std::map<site_key, site_record*> sites;
+    ::std::atomic<site_record*> head;
+    bool at_exit;
+  };
+
+  static site_registry& registry() {
+    static site_registry* r = new site_registry;
+    return *r;
+  }
+
+  static site_record& find_or_add(const char* element_type,
+                                  ::std::size_t element_size,
+                                  ::std::size_t small_size,
+                                  const small_vector_site& site) {
+    site_registry& r = registry();
+    ::std::lock_guard< ::std::mutex> lock(r.mutex);
+    const site_key key = { element_type, small_size, site.file, site.line };
+    site_record*& record = r.sites[key];
+    if (!record) {
+      if (r.sites.size() == 1) {
+        ::std::atexit(&report_to_stderr);
+      }
+      record = new site_record(site, element_type, element_size, small_size);
+      record->m_next = r.head.load();
+      r.head.store(record);
+    }
+    return *record;
+  }
+
+  static bool busier(const site_record* lhs, const site_record* rhs) {
+    return lhs->vectors() > rhs->vectors();
+  }
+
+  static void report_to_stderr() {
+    if (registry().at_exit) {
+      report(stderr);
+    }
+  }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+// Per-instantiation counters for small_vector, enabled by building with
+// SMALLVECTOR_STATS defined. small_vector.h includes this header itself
+// in that case; without SMALLVECTOR_STATS none of it is compiled in.
+//
+// For every small_vector<T, N> that is used, this counts how many
+// vectors were constructed, how many were destroyed without ever having
+// left their small storage, how often they spilled to the heap, how
+// often they reallocated after that, how many bytes of elements were
+// relocated, and the largest size any of them reached. The counters are
+// atomic, so they can be updated from any thread.
+//
+// The counters are available through small_vector_stats::first() and
+// ::for_type<T, N>(), and are written to stderr at exit unless
+// small_vector_stats::dump_at_exit(false) is called.
+
+#if __cplusplus < 201103L
+#error "SMALLVECTOR_STATS requires C++11"
+#endif
+
+#include "small_vector_demangle.h"
+
+#include <atomic>       // std::atomic
+#include <cstddef>      // std::size_t
+#include <cstdio>       // std::FILE, std::fprintf
+#include <cstdlib>      // std::atexit, std::free
+#include <typeinfo>     // typeid
+
+class small_vector_stats {
+public:
+  typedef unsigned long long counter_type;
+
+  // What's being counted
+  const char* element_type() const { return m_element_type; }
+  ::std::size_t element_size() const { return m_element_size; }
+  ::std::size_t small_size() const { return m_small_size; }
+
+  counter_type constructions() const { return m_constructions.load(); }
+  counter_type destructions() const { return m_destructions.load(); }
+  // Vectors destroyed without ever having used the heap
+  counter_type inline_lifetimes() const { return m_inline_lifetimes.load(); }
+  // Moves from the small storage to the heap
+  counter_type spills() const { return m_spills.load(); }
+  // Moves from the heap to more (or less) heap, or back to small storage
+  counter_type reallocations() const { return m_reallocations.load(); }
+  counter_type bytes_relocated() const { return m_bytes_relocated.load(); }
+  ::std::size_t peak_size() const { return m_peak_size.load(); }
+
+  // The next instantiation's counters, or NULL
+  const small_vector_stats* next() const { return m_next; }
+
+  // The counters for every instantiation used so far, most recent first
+  static const small_vector_stats* first() { return head().load(); }
+
+  // The counters for small_vector<T, SmallSize>
+  template <class T, ::std::size_t SmallSize>
+  static small_vector_stats& for_type() {
+    static small_vector_stats stats(typeid(T), sizeof(T), SmallSize);
+    return stats;
+  }
+
+  // Writes a table of every instantiation's counters to out
+  static void dump(::std::FILE* out) {
+    ::std::fprintf(out, "%-32s %6s %6s %12s %8s %10s %10s %14s %10s\n",
+                   "small_vector<T, N>", "N", "sizeof",
+                   "constructed", "inline%", "spills", "reallocs",
+                   "bytes moved", "peak size");
+    for (const small_vector_stats* s = first(); s; s = s->next()) {
+      const counter_type destroyed = s->destructions();
+      ::std::fprintf(out, "%-32s %6zu %6zu %12llu %7.1f%% %10llu %10llu "
+                     "%14llu %10zu\n",
+                     s->element_type(), s->small_size(), s->element_size(),
+                     s->constructions(),
+                     destroyed ? 100.0 * s->inline_lifetimes() / destroyed
+                               : 0.0,
+                     s->spills(), s->reallocations(), s->bytes_relocated(),
+                     s->peak_size());
+    }
+  }
+
+  // Whether to dump() to stderr at exit. On by default.
+  static void dump_at_exit(bool enable) { dump_enabled() = enable; }
+
+  // Called by small_vector
+  void on_construct() { ++m_constructions; }
+  void on_destroy(bool inline_only, ::std::size_t size) {
+    ++m_destructions;
+    if (inline_only) {
+      ++m_inline_lifetimes;
+    }
+    on_size(size);
+  }
+  void on_spill() { ++m_spills; }
+  void on_reallocate() { ++m_reallocations; }
+  void on_relocate(::std::size_t bytes) { m_bytes_relocated += bytes; }
+  void on_size(::std::size_t size) {
+    ::std::size_t peak = m_peak_size.load(::std::memory_order_relaxed);
+    while (size > peak &&
+           !m_peak_size.compare_exchange_weak(peak, size,
+                                              ::std::memory_order_relaxed)) {
+    }
+  }
+
+private:
+  small_vector_stats(const ::std::type_info& type,
+                     ::std::size_t element_size, ::std::size_t small_size) :
+    m_element_type(small_vector_demangle(type)),
+    m_element_size(element_size),
+    m_small_size(small_size),
+    m_constructions(0),
+    m_destructions(0),
+    m_inline_lifetimes(0),
+    m_spills(0),
+    m_reallocations(0),
+    m_bytes_relocated(0),
+    m_peak_size(0),
+    m_next(NULL) {
+    register_at_exit();
+    // Lock-free push onto the list of instantiations
+    m_next = head().load();
+    while (!head().compare_exchange_weak(m_next, this)) {
+    }
+  }
+
+  static ::std::atomic<small_vector_stats*>& head() {
+    static ::std::atomic<small_vector_stats*> h(NULL);
+    return h;
+  }
+
+  static bool& dump_enabled() {
+    static bool enabled = true;
+    return enabled;
+  }
+
+  static void dump_to_stderr() {
+    if (dump_enabled()) {
+      dump(stderr);
+    }
+  }
+
+  static void register_at_exit() {
+    static bool registered = (::std::atexit(&dump_to_stderr), true);
+    (void)registered;
+  }
+
+  const char* m_element_type;
+  ::std::size_t m_element_size;
+  ::std::size_t m_small_size;
+  ::std::atomic<counter_type> m_constructions;
+  ::std::atomic<counter_type> m_destructions;
+  ::std::atomic<counter_type> m_inline_lifetimes;
+  ::std::atomic<counter_type> m_spills;
+  ::std::atomic<counter_type> m_reallocations;
+  ::std::atomic<counter_type> m_bytes_relocated;
+  ::std::atomic< ::std::size_t> m_peak_size;
+  small_vector_stats* m_next;
+
+  small_vector_stats(const small_vector_stats&);
+  small_vector_stats& operator=(const small_vector_stats&);
+};
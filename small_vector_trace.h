@@ -0,0 +1,191 @@
+#pragma once
+
+// Operation tracing for small_vector, for tuning configurations offline.
+// Enabled by building with SMALLVECTOR_TRACE defined; small_vector.h
+// includes this header itself in that case.
+//
+// Between small_vector_trace::start(path) and stop(), every small_vector
+// constructed appends a 16-byte record to the trace for each operation
+// on it: construction, copy, push_back, append (including commit),
+// insert, erase (including pop_back), reserve, shrink_to_fit, clear and
+// destruction, with the size after the operation and the vector's
+// element size and small size. Only calls the user makes are recorded:
+// a reserve() inside append() is left for the replay to redo under its
+// own growth policy. Vectors constructed while no trace is running are
+// never recorded, and pay one branch per operation.
+//
+// Records collect in a buffer per thread, which is written out when it
+// fills, when the thread exits, and on flush(). stop() flushes only the
+// calling thread; other threads should exit or flush() first, or their
+// last records are dropped. Each thread's records stay in order, but
+// records from different threads are interleaved a buffer at a time, so
+// a vector handed between threads may not replay in order.
+//
+// bench/replay.cpp replays a trace with other small sizes, growth
+// policies and allocators. It includes this header, after
+// small_vector.h, for the file format only.
+
+#if __cplusplus < 201103L
+#error "SMALLVECTOR_TRACE requires C++11"
+#endif
+
+#include <atomic>       // std::atomic
+#include <cstddef>      // std::size_t
+#include <cstdint>      // std::uint8_t, std::uint16_t, std::uint32_t
+#include <cstdio>       // std::FILE, std::fopen, std::fwrite
+#include <cstring>      // std::memcpy
+#include <mutex>        // std::mutex, std::lock_guard
+
+struct small_vector_trace_record {
+  ::std::uint32_t vector;         // Unique within a trace, never 0
+  ::std::uint32_t size;
+  ::std::uint16_t element_size;   // sizeof(T), at most 65535
+  ::std::uint16_t small_size;     // At most 65535
+  ::std::uint8_t op;              // A small_vector_operation::type
+  ::std::uint8_t reserved[3];
+};
+
+static_assert(sizeof(small_vector_trace_record) == 16,
+              "trace records are 16 bytes on disk");
+
+// A trace file is this header followed by records, in native byte order
+struct small_vector_trace_header {
+  char magic[8];                  // "SVTRACE"
+  ::std::uint32_t version;        // 1
+  ::std::uint32_t record_size;    // sizeof(small_vector_trace_record)
+};
+
+class small_vector_trace {
+public:
+  typedef small_vector_trace_record record_type;
+
+  // Records each thread buffers before writing them out
+  static const ::std::size_t buffer_records = 4096;
+
+  // Starts writing a trace to path, replacing any trace running
+  // already. Returns false if path can't be opened.
+  static bool start(const char* path) {
+    stop();
+    ::std::FILE* file = ::std::fopen(path, "wb");
+    if (!file) {
+      return false;
+    }
+    small_vector_trace_header header;
+    ::std::memcpy(header.magic, "SVTRACE", 8);
+    header.version = 1;
+    header.record_size = sizeof(record_type);
+    ::std::fwrite(&header, sizeof(header), 1, file);
+
+    writer& w = get_writer();
+    ::std::lock_guard< ::std::mutex> lock(w.mutex);
+    w.file = file;
+    w.dropped = 0;
+    active().store(true);
+    return true;
+  }
+
+  // Flushes this thread's records and closes the trace
+  static void stop() {
+    if (!active().exchange(false)) {
+      return;
+    }
+    flush();
+    writer& w = get_writer();
+    ::std::lock_guard< ::std::mutex> lock(w.mutex);
+    ::std::fclose(w.file);
+    w.file = NULL;
+  }
+
+  static bool recording() {
+    return active().load(::std::memory_order_relaxed);
+  }
+
+  // An id for a vector being constructed, or 0 if there's no trace.
+  // Ids aren't reused by later traces.
+  static ::std::uint32_t new_id() {
+    if (__builtin_expect(!recording(), 1)) {
+      return 0;
+    }
+    return next_id().fetch_add(1, ::std::memory_order_relaxed) + 1;
+  }
+
+  static void record(::std::uint32_t vector, small_vector_operation::type op,
+                     ::std::size_t size, ::std::size_t element_size,
+                     ::std::size_t small_size) {
+    buffer& b = local_buffer();
+    record_type& r = b.records[b.count];
+    r.vector = vector;
+    r.size = static_cast< ::std::uint32_t>(size);
+    r.element_size = static_cast< ::std::uint16_t>(
+      element_size < 65535 ? element_size : 65535);
+    r.small_size = static_cast< ::std::uint16_t>(
+      small_size < 65535 ? small_size : 65535);
+    r.op = static_cast< ::std::uint8_t>(op);
+    r.reserved[0] = r.reserved[1] = r.reserved[2] = 0;
+    if (++b.count == buffer_records) {
+      b.flush();
+    }
+  }
+
+  // Writes out this thread's buffered records
+  static void flush() { local_buffer().flush(); }
+
+  // Records dropped because they were flushed after stop()
+  static unsigned long long dropped() {
+    writer& w = get_writer();
+    ::std::lock_guard< ::std::mutex> lock(w.mutex);
+    return w.dropped;
+  }
+
+private:
+  struct writer {
+    writer() : file(NULL), dropped(0) {}
+    ::std::mutex mutex;
+    ::std::FILE* file;
+    unsigned long long dropped;
+  };
+
+  struct buffer {
+    buffer() : count(0) {}
+    ~buffer() { flush(); }
+
+    void flush() {
+      if (!count) {
+        return;
+      }
+      writer& w = get_writer();
+      ::std::lock_guard< ::std::mutex> lock(w.mutex);
+      if (w.file) {
+        ::std::fwrite(records, sizeof(record_type), count, w.file);
+      } else {
+        w.dropped += count;
+      }
+      count = 0;
+    }
+
+    record_type records[buffer_records];
+    ::std::size_t count;
+  };
+
+  static ::std::atomic<bool>& active() {
+    static ::std::atomic<bool> a(false);
+    return a;
+  }
+
+  static ::std::atomic< ::std::uint32_t>& next_id() {
+    static ::std::atomic< ::std::uint32_t> id(0);
+    return id;
+  }
+
+  static buffer& local_buffer() {
+    static thread_local buffer b;
+    return b;
+  }
+
+  // Lives until exit, so that threads may still flush during static
+  // destruction
+  static writer& get_writer() {
+    static writer* w = new writer;
+    return *w;
+  }
+};
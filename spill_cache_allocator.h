@@ -0,0 +1,246 @@
+#pragma once
+
+#if __cplusplus < 201103L
+#error "spill_cache_allocator.h requires C++11"
+#endif
+
+#include <cstddef>      // std::size_t, std::ptrdiff_t
+#include <cstdlib>      // std::malloc, std::free
+#include <mutex>        // std::mutex, std::lock_guard
+#include <new>          // std::bad_alloc
+
+// A per-thread cache of freed blocks, in size classes of
+// BlockBytes << k for k in [0, Classes). Blocks are plain malloc memory,
+// so any thread may free a block that another allocated.
+//
+// Each thread keeps up to about LocalBytes worth of blocks per class
+// (at least two, at most 64). When a thread's list overflows, half of it
+// goes to a process-wide depot shared by all threads, which holds up to
+// eight times as much per class; past that, blocks go back to malloc.
+// When a thread's list runs dry, it refills from the depot before
+// calling malloc. This keeps memory bounded, and lets blocks that are
+// freed on a different thread than they were allocated on (producer/
+// consumer handoff) find their way back to threads that allocate.
+template <::std::size_t BlockBytes,
+          ::std::size_t Classes = 8,
+          ::std::size_t LocalBytes = 32 * 1024>
+class spill_cache {
+public:
+  static ::std::size_t class_bytes(::std::size_t k) {
+    return BlockBytes << k;
+  }
+
+  // Returns a block of class_bytes(k) bytes. Requires: k < Classes
+  static void* allocate(::std::size_t k) {
+    local_cache& local = get_local();
+    free_list& list = local.lists[k];
+    if (!list.head) {
+      refill(list, k);
+      if (!list.head) {
+        ++local.upstream_allocations;
+        void* p = ::std::malloc(class_bytes(k));
+        if (!p) {
+          throw ::std::bad_alloc();
+        }
+        return p;
+      }
+    }
+    return list.pop();
+  }
+
+  // Gives back a block of class k
+  static void deallocate(void* p, ::std::size_t k) {
+    free_list& list = get_local().lists[k];
+    if (list.count >= local_limit(k)) {
+      spill(list, k, local_limit(k) / 2);
+    }
+    list.push(static_cast<block*>(p));
+  }
+
+  // How many times this thread has gone to malloc for a block
+  static ::std::size_t upstream_allocations() {
+    return get_local().upstream_allocations;
+  }
+
+  // Blocks of class k cached by this thread
+  static ::std::size_t cached_blocks(::std::size_t k) {
+    return get_local().lists[k].count;
+  }
+
+private:
+  struct block {
+    block* next;
+  };
+
+  struct free_list {
+    free_list() : head(nullptr), count(0) {}
+    void push(block* b) {
+      b->next = head;
+      head = b;
+      ++count;
+    }
+    block* pop() {
+      block* b = head;
+      head = b->next;
+      --count;
+      return b;
+    }
+    void release() {
+      while (head) {
+        ::std::free(pop());
+      }
+    }
+    block* head;
+    ::std::size_t count;
+  };
+
+  static ::std::size_t local_limit(::std::size_t k) {
+    const ::std::size_t n = LocalBytes / class_bytes(k);
+    return n < 2 ? 2 : n > 64 ? 64 : n;
+  }
+  static ::std::size_t depot_limit(::std::size_t k) {
+    return 8 * local_limit(k);
+  }
+
+  struct depot {
+    ~depot() {
+      for (::std::size_t k=0; k<Classes; ++k) {
+        lists[k].release();
+      }
+    }
+    ::std::mutex mutex;
+    free_list lists[Classes];
+  };
+
+  struct local_cache {
+    local_cache() : upstream_allocations(0) {
+      // Make sure the depot outlives us
+      get_depot();
+    }
+    ~local_cache() {
+      for (::std::size_t k=0; k<Classes; ++k) {
+        spill(lists[k], k, lists[k].count);
+      }
+    }
+    free_list lists[Classes];
+    ::std::size_t upstream_allocations;
+  };
+
+  static depot& get_depot() {
+    static depot d;
+    return d;
+  }
+
+  static local_cache& get_local() {
+    static thread_local local_cache cache;
+    return cache;
+  }
+
+  // Moves n blocks from a thread's list to the depot, freeing any that
+  // don't fit
+  static void spill(free_list& list, ::std::size_t k, ::std::size_t n) {
+    depot& d = get_depot();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    free_list& shared = d.lists[k];
+    for ( ; n > 0; --n) {
+      block* b = list.pop();
+      if (shared.count < depot_limit(k)) {
+        shared.push(b);
+      } else {
+        ::std::free(b);
+      }
+    }
+  }
+
+  // Moves up to half a thread's worth of blocks from the depot into an
+  // empty list
+  static void refill(free_list& list, ::std::size_t k) {
+    depot& d = get_depot();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    free_list& shared = d.lists[k];
+    for (::std::size_t n = local_limit(k) / 2; n > 0 && shared.head; --n) {
+      list.push(shared.pop());
+    }
+  }
+};
+
+// An allocator for small_vector<T, SmallSize> that caches the heap
+// buffers it frees, so that vectors which spill and are then destroyed
+// stop going to malloc. Only capacities on small_vector's growth
+// sequence are cached (2 * SmallSize, 4 * SmallSize, ... for Classes
+// steps, or 1, 2, 4, ... if SmallSize is 0); other sizes, e.g. from
+// reserve() or shrink_to_fit(), are passed straight to malloc and free.
+// See spill_cache for how much memory is kept.
+//
+// Instantiations whose first spill has the same size in bytes share a
+// cache.
+template <class T,
+          ::std::size_t SmallSize,
+          ::std::size_t Classes = 8>
+class spill_cache_allocator {
+  static const ::std::size_t first_spill = SmallSize ? 2 * SmallSize : 1;
+  // Blocks hold a free-list pointer while cached, so tiny classes are
+  // padded to fit one
+  static const ::std::size_t block_bytes =
+    first_spill * sizeof(T) < sizeof(void*) ? sizeof(void*)
+                                            : first_spill * sizeof(T);
+public:
+  typedef T                   value_type;
+  typedef T*                  pointer;
+  typedef const T*            const_pointer;
+  typedef T&                  reference;
+  typedef const T&            const_reference;
+  typedef ::std::size_t       size_type;
+  typedef ::std::ptrdiff_t    difference_type;
+  template <class U>
+  struct rebind { typedef spill_cache_allocator<U, SmallSize, Classes> other; };
+
+  typedef spill_cache<block_bytes, Classes> cache_type;
+
+  spill_cache_allocator() {}
+  template <class U>
+  spill_cache_allocator(const spill_cache_allocator<U, SmallSize, Classes>&) {}
+
+  pointer allocate(size_type n) {
+    const size_type k = size_class(n);
+    if (k < Classes) {
+      return static_cast<pointer>(cache_type::allocate(k));
+    }
+    void* p = ::std::malloc(n * sizeof(T));
+    if (!p) {
+      throw ::std::bad_alloc();
+    }
+    return static_cast<pointer>(p);
+  }
+
+  void deallocate(pointer p, size_type n) {
+    const size_type k = size_class(n);
+    if (k < Classes) {
+      cache_type::deallocate(p, k);
+    } else {
+      ::std::free(p);
+    }
+  }
+
+  // The cache class for a buffer of n objects, or Classes if n is not on
+  // the growth sequence
+  static size_type size_class(size_type n) {
+    for (size_type k=0; k<Classes; ++k) {
+      if (n == first_spill << k) {
+        return k;
+      }
+    }
+    return Classes;
+  }
+};
+
+template <class T, class U, ::std::size_t SmallSize, ::std::size_t Classes>
+bool operator==(const spill_cache_allocator<T, SmallSize, Classes>&,
+                const spill_cache_allocator<U, SmallSize, Classes>&) {
+  return true;
+}
+template <class T, class U, ::std::size_t SmallSize, ::std::size_t Classes>
+bool operator!=(const spill_cache_allocator<T, SmallSize, Classes>&,
+                const spill_cache_allocator<U, SmallSize, Classes>&) {
+  return false;
+}
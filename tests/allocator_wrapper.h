@@ -1,6 +1,9 @@
 #pragma once
 
-// Wraps an allocator and monitors calls to allocate, etc
+#include "instrumentation.h"
+
+// Wraps an allocator and monitors calls to allocate, etc. Counts are kept
+// per wrapped allocator type, and in the instrumentation counters.
 template <class Allocator>
 class allocator_wrapper {
 public:
@@ -25,9 +28,14 @@ public:
   pointer allocate(
       size_type n, std::allocator<void>::const_pointer hint = 0) {
     ++NumAllocs();
+    NumBytes() += n * sizeof(value_type);
+    ++instrumentation::allocs();
+    instrumentation::bytes() += n * sizeof(value_type);
     return m_allocator.allocate(n, hint);
   }
   void deallocate(pointer p, size_type n) {
+    ++NumFrees();
+    ++instrumentation::frees();
     m_allocator.deallocate(p, n);
   }
   size_type max_size() const { return m_allocator.max_size(); }
@@ -43,7 +51,57 @@ public:
     static unsigned _NumAllocs;
     return _NumAllocs;
   }
+  static unsigned& NumFrees() {
+    static unsigned _NumFrees;
+    return _NumFrees;
+  }
+  // Bytes requested from allocate(), not net of frees
+  static unsigned long& NumBytes() {
+    static unsigned long _NumBytes;
+    return _NumBytes;
+  }
 private:
   Allocator m_allocator;
 };
 
+
+// An allocator_wrapper with state: a tag that tells instances apart.
+// Instances only compare equal if their tags do.
+template <class Allocator>
+class tagged_allocator : public allocator_wrapper<Allocator> {
+public:
+  template <class U>
+  struct rebind { typedef tagged_allocator<Allocator> other; };
+
+  explicit tagged_allocator(int tag = 0) : m_tag(tag) {}
+  tagged_allocator(const tagged_allocator<Allocator>& rhs) :
+    allocator_wrapper<Allocator>(rhs), m_tag(rhs.m_tag) {}
+
+  int tag() const { return m_tag; }
+
+  bool operator==(const tagged_allocator<Allocator>& rhs) const {
+    return m_tag == rhs.m_tag;
+  }
+  bool operator!=(const tagged_allocator<Allocator>& rhs) const {
+    return m_tag != rhs.m_tag;
+  }
+private:
+  int m_tag;
+};
+
+// A tagged_allocator whose copies made for a copied container get a
+// tag of -1, through select_on_container_copy_construction
+template <class Allocator>
+class fresh_copy_allocator : public tagged_allocator<Allocator> {
+public:
+  template <class U>
+  struct rebind { typedef fresh_copy_allocator<Allocator> other; };
+
+  explicit fresh_copy_allocator(int tag = 0) :
+    tagged_allocator<Allocator>(tag) {}
+
+  fresh_copy_allocator<Allocator>
+    select_on_container_copy_construction() const {
+    return fresh_copy_allocator<Allocator>(-1);
+  }
+};
@@ -0,0 +1,459 @@
+#include "small_vector.h"
+#include "mmap_allocator.h"
+#include "arena_allocator.h"
+#include "buffer_allocator.h"
+#include "allocator_wrapper.h"
+#include "gtest/gtest.h"
+#include <cstdlib>
+
+// mmap_allocator maps buffers past its threshold and moves them with
+// mremap; the contents must survive growing and shrinking across it
+TEST(mmap_allocator, grow_and_shrink) {
+  typedef mmap_allocator<int, 4096> allocator_type;
+  small_vector<int, 8, allocator_type> vec;
+
+  // Crosses from the small storage, through malloc, to a mapping
+  for (int i=0; i<100000; ++i) vec.push_back(i);
+  ASSERT_EQ(100000u, vec.size());
+  for (int i=0; i<100000; ++i) ASSERT_EQ(i, vec[i]);
+
+  vec.reserve(1000000);
+  EXPECT_EQ(1000000u, vec.capacity());
+  for (int i=0; i<100000; ++i) ASSERT_EQ(i, vec[i]);
+
+  vec.shrink_to_fit();
+  EXPECT_EQ(100000u, vec.capacity());
+  for (int i=0; i<100000; ++i) ASSERT_EQ(i, vec[i]);
+}
+
+// Falls back to allocate-copy-free when crossing the threshold
+TEST(mmap_allocator, reallocate_across_threshold) {
+  typedef mmap_allocator<int, 4096> allocator_type;
+  allocator_type alloc;
+
+  int* p = alloc.allocate(10);
+  for (int i=0; i<10; ++i) p[i] = i;
+  p = alloc.reallocate(p, 10, 5000);
+  for (int i=0; i<10; ++i) ASSERT_EQ(i, p[i]);
+  for (int i=10; i<5000; ++i) p[i] = i;
+  p = alloc.reallocate(p, 5000, 20);
+  for (int i=0; i<20; ++i) ASSERT_EQ(i, p[i]);
+  alloc.deallocate(p, 20);
+}
+
+// Elements that can't be relocated bytewise still work, through
+// the ordinary allocate-move-deallocate path
+namespace {
+  struct self_pointer {
+    self_pointer() : self(this) {}
+    self_pointer(const self_pointer&) : self(this) {}
+    self_pointer& operator=(const self_pointer&) { return *this; }
+    self_pointer* self;
+  };
+}
+TEST(mmap_allocator, non_relocatable) {
+  EXPECT_FALSE(small_vector_trivially_relocatable<self_pointer>::value);
+  small_vector<self_pointer, 2, mmap_allocator<self_pointer, 4096> > vec;
+  for (int i=0; i<2000; ++i) vec.push_back(self_pointer());
+  for (int i=0; i<2000; ++i) ASSERT_EQ(&vec[i], vec[i].self);
+}
+
+// Spilling into an arena takes memory from it, and giving the
+// memory back is a no-op
+TEST(arena_allocator, spills_into_arena) {
+  monotonic_arena arena;
+  typedef arena_allocator<int> allocator_type;
+  EXPECT_TRUE(small_vector_allocator_is_monotonic<allocator_type>::value);
+
+  {
+    small_vector<int, 4, allocator_type> vec((allocator_type(arena)));
+    for (int i=0; i<4; ++i) vec.push_back(i);
+    EXPECT_EQ(0u, arena.bytes_allocated());
+
+    // 4 -> 8 -> 16
+    for (int i=4; i<10; ++i) vec.push_back(i);
+    EXPECT_EQ(24 * sizeof(int), arena.bytes_allocated());
+    for (int i=0; i<10; ++i) EXPECT_EQ(i, vec[i]);
+  }
+  EXPECT_EQ(24 * sizeof(int), arena.bytes_allocated());
+
+  arena.release();
+  EXPECT_EQ(0u, arena.bytes_allocated());
+}
+
+// Allocations bigger than a chunk get a chunk of their own, and
+// everything stays aligned
+TEST(monotonic_arena, large_and_aligned) {
+  monotonic_arena arena(64);
+  char* c = static_cast<char*>(arena.allocate(1, 1));
+  double* d = static_cast<double*>(arena.allocate(sizeof(double),
+                                                  sizeof(double)));
+  EXPECT_EQ(0u, reinterpret_cast<std::size_t>(d) % sizeof(double));
+  *c = 'x';
+  *d = 1.5;
+
+  char* big = static_cast<char*>(arena.allocate(1000, 8));
+  for (int i=0; i<1000; ++i) big[i] = 'y';
+  EXPECT_EQ(1u + sizeof(double) + 1000, arena.bytes_allocated());
+
+  arena.release();
+  arena.allocate(32, 8);
+  EXPECT_EQ(32u, arena.bytes_allocated());
+}
+
+// A request that needs several chunks leaves one chunk big enough for
+// all of it, so the same request again doesn't call malloc
+namespace {
+  void arena_request(monotonic_arena& arena) {
+    typedef arena_allocator<int> allocator_type;
+    small_vector<int, 4, allocator_type> ints((allocator_type(arena)));
+    for (int i=0; i<300; ++i) ints.push_back(i);
+    arena.allocate(3, 1);
+    arena.allocate(500, 8);
+    small_vector<double, 2, arena_allocator<double> >
+      doubles((arena_allocator<double>(arena)));
+    for (int i=0; i<40; ++i) doubles.push_back(i);
+  }
+}
+
+TEST(monotonic_arena, release_keeps_enough) {
+  monotonic_arena arena(256);
+  arena_request(arena);
+  EXPECT_GT(arena.chunk_allocations(), 1u);
+  const std::size_t bytes = arena.bytes_allocated();
+  arena.release();
+  const std::size_t chunks = arena.chunk_allocations();
+
+  for (int i=0; i<3; ++i) {
+    arena_request(arena);
+    EXPECT_EQ(bytes, arena.bytes_allocated());
+    arena.release();
+  }
+  EXPECT_EQ(chunks, arena.chunk_allocations());
+}
+
+// Destructors still run for elements that need them, even though
+// the memory is never given back
+namespace {
+  int NumCounted = 0;
+  struct counted {
+    counted() { ++NumCounted; }
+    counted(const counted&) { ++NumCounted; }
+    counted& operator=(const counted&) { return *this; }
+    ~counted() { --NumCounted; }
+  };
+}
+TEST(arena_allocator, runs_destructors) {
+  monotonic_arena arena;
+  EXPECT_FALSE(small_vector_trivially_destructible<counted>::value);
+  {
+    typedef arena_allocator<counted> allocator_type;
+    small_vector<counted, 2, allocator_type> vec((allocator_type(arena)));
+    for (int i=0; i<5; ++i) vec.push_back(counted());
+    EXPECT_EQ(5, NumCounted);
+  }
+  EXPECT_EQ(0, NumCounted);
+}
+
+// Allocators are rebound to the element type
+TEST(allocator_traits, rebinds) {
+  typedef small_vector<int, 4, std::allocator<char> > vec_type;
+  std::allocator<int> alloc = vec_type().get_allocator();
+  (void)alloc;
+  vec_type vec;
+  for (int i=0; i<10; ++i) vec.push_back(i);
+  for (int i=0; i<10; ++i) EXPECT_EQ(i, vec[i]);
+}
+
+#if __cplusplus >= 201103L
+namespace {
+  // Only what C++11 requires of an allocator; no construct, destroy,
+  // rebind, or typedefs other than value_type
+  template <class T>
+  struct minimal_allocator {
+    typedef T value_type;
+
+    explicit minimal_allocator(int id = 0) : id(id) {}
+    template <class U>
+    minimal_allocator(const minimal_allocator<U>& rhs) : id(rhs.id) {}
+
+    T* allocate(std::size_t n) {
+      return static_cast<T*>(std::malloc(n * sizeof(T)));
+    }
+    void deallocate(T* p, std::size_t) { std::free(p); }
+
+    // Follows its contents on copy assignment
+    typedef std::true_type propagate_on_container_copy_assignment;
+
+    int id;
+  };
+  template <class T, class U>
+  bool operator==(const minimal_allocator<T>& lhs,
+                  const minimal_allocator<U>& rhs) {
+    return lhs.id == rhs.id;
+  }
+  template <class T, class U>
+  bool operator!=(const minimal_allocator<T>& lhs,
+                  const minimal_allocator<U>& rhs) {
+    return lhs.id != rhs.id;
+  }
+}
+
+TEST(allocator_traits, minimal_allocator) {
+  small_vector<int, 2, minimal_allocator<int> > vec;
+  for (int i=0; i<10; ++i) vec.push_back(i);
+  for (int i=0; i<10; ++i) EXPECT_EQ(i, vec[i]);
+  vec.shrink_to_fit();
+  EXPECT_EQ(10u, vec.capacity());
+}
+
+// propagate_on_container_copy_assignment is honored
+TEST(allocator_traits, propagate_on_copy_assignment) {
+  typedef small_vector<int, 2, minimal_allocator<int> > vec_type;
+  vec_type a((minimal_allocator<int>(1)));
+  vec_type b((minimal_allocator<int>(2)));
+  for (int i=0; i<10; ++i) a.push_back(i);
+  for (int i=0; i<5; ++i) b.push_back(-i);
+
+  a = b;
+  EXPECT_EQ(2, a.get_allocator().id);
+  ASSERT_EQ(5u, a.size());
+  for (int i=0; i<5; ++i) EXPECT_EQ(-i, a[i]);
+}
+#endif
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+// pmr::small_vector takes its heap memory from a memory_resource, and
+// nested vectors pick up the outer vector's resource
+TEST(pmr, nested_vectors_share_resource) {
+  char buffer[16384];
+  std::pmr::monotonic_buffer_resource pool(
+      buffer, sizeof(buffer), std::pmr::null_memory_resource());
+
+  typedef pmr::small_vector<int, 2> inner_type;
+  pmr::small_vector<inner_type, 2> outer(&pool);
+
+  for (int i=0; i<8; ++i) {
+    // Made with the default resource
+    inner_type inner;
+    inner.push_back(i);
+    outer.push_back(inner);
+  }
+
+  // Nothing may come from the default resource from here on
+  std::pmr::memory_resource* old_default =
+    std::pmr::set_default_resource(std::pmr::null_memory_resource());
+  for (int i=0; i<8; ++i) {
+    EXPECT_EQ(&pool, outer[i].get_allocator().resource());
+    for (int j=0; j<10; ++j) outer[i].push_back(j);
+    ASSERT_EQ(11u, outer[i].size());
+    EXPECT_EQ(i, outer[i][0]);
+  }
+  std::pmr::set_default_resource(old_default);
+}
+#endif
+#endif
+
+// A buffer_allocator's buffer is the second tier: the vector spills
+// into all of it before going to the heap
+TEST(buffer_allocator, spills_into_buffer_then_heap) {
+  typedef allocator_wrapper< std::allocator<int> > upstream_type;
+  typedef buffer_allocator<int, upstream_type> allocator_type;
+  upstream_type::NumAllocs() = 0;
+
+  int scratch[32];
+  buffer_resource<int> buffer(scratch, 32);
+  small_vector<int, 4, allocator_type> vec((allocator_type(buffer)));
+  for (int i=0; i<4; ++i) vec.push_back(i);
+  EXPECT_TRUE(vec.is_small());
+
+  vec.push_back(4);
+  EXPECT_FALSE(vec.is_small());
+  EXPECT_EQ(scratch, vec.begin());
+  EXPECT_EQ(32u, vec.capacity());
+  EXPECT_TRUE(vec.get_allocator().owns(vec.begin()));
+
+  for (int i=5; i<32; ++i) vec.push_back(i);
+  EXPECT_EQ(scratch, vec.begin());
+  EXPECT_EQ(0u, upstream_type::NumAllocs());
+
+  vec.push_back(32);
+  EXPECT_NE(scratch, vec.begin());
+  EXPECT_FALSE(vec.get_allocator().owns(vec.begin()));
+  EXPECT_EQ(64u, vec.capacity());
+  EXPECT_EQ(1u, upstream_type::NumAllocs());
+  for (int i=0; i<33; ++i) EXPECT_EQ(i, vec[i]);
+
+  // Once the vector has moved out of the buffer, it can be used again
+  vec.clear();
+  vec.shrink_to_fit();
+  EXPECT_TRUE(vec.is_small());
+  vec.reserve(10);
+  EXPECT_EQ(scratch, vec.begin());
+  EXPECT_EQ(32u, vec.capacity());
+}
+
+// shrink_to_fit() keeps a vector in the buffer rather than moving it to
+// a smaller heap block, but still moves it back into small storage
+TEST(buffer_allocator, shrink_stays_in_buffer) {
+  typedef allocator_wrapper< std::allocator<int> > upstream_type;
+  typedef buffer_allocator<int, upstream_type> allocator_type;
+  upstream_type::NumAllocs() = 0;
+
+  int scratch[32];
+  buffer_resource<int> buffer(scratch, 32);
+  small_vector<int, 4, allocator_type> vec((allocator_type(buffer)));
+  for (int i=0; i<10; ++i) vec.push_back(i);
+  ASSERT_EQ(scratch, vec.begin());
+
+  vec.shrink_to_fit();
+  EXPECT_EQ(scratch, vec.begin());
+  EXPECT_EQ(32u, vec.capacity());
+  EXPECT_EQ(0u, upstream_type::NumAllocs());
+  for (int i=0; i<10; ++i) EXPECT_EQ(i, vec[i]);
+
+  vec.erase(vec.begin() + 3, vec.end());
+  vec.shrink_to_fit();
+  EXPECT_TRUE(vec.is_small());
+  EXPECT_EQ(0u, upstream_type::NumAllocs());
+
+  // The buffer is free again
+  for (int i=3; i<10; ++i) vec.push_back(i);
+  EXPECT_EQ(scratch, vec.begin());
+  EXPECT_EQ(0u, upstream_type::NumAllocs());
+}
+
+// The buffer is never handed out twice, e.g. while moving out of it
+TEST(buffer_allocator, buffer_in_use) {
+  int scratch[16];
+  buffer_resource<int> buffer(scratch, 16);
+  buffer_allocator<int> alloc(buffer);
+  std::size_t count = 0;
+  EXPECT_EQ(scratch, alloc.allocate_at_least(4, count));
+  EXPECT_EQ(16u, count);
+  int* p = alloc.allocate_at_least(8, count);
+  EXPECT_NE(scratch, p);
+  EXPECT_EQ(8u, count);
+  alloc.deallocate(scratch, 16);
+  alloc.deallocate(p, 8);
+  EXPECT_EQ(scratch, alloc.allocate(16));
+
+  // Too big for the buffer
+  p = alloc.allocate_at_least(17, count);
+  EXPECT_NE(scratch, p);
+  alloc.deallocate(p, count);
+}
+
+// Copies of a vector that lives in a buffer go to the heap
+TEST(buffer_allocator, copies_do_not_share) {
+  typedef buffer_allocator<int> allocator_type;
+  int scratch[16];
+  buffer_resource<int> buffer(scratch, 16);
+  small_vector<int, 2, allocator_type> vec((allocator_type(buffer)));
+  for (int i=0; i<10; ++i) vec.push_back(i);
+  ASSERT_EQ(scratch, vec.begin());
+
+  small_vector<int, 2, allocator_type> copy(vec);
+  EXPECT_NE(scratch, copy.begin());
+  EXPECT_EQ(NULL, copy.get_allocator().buffer());
+  ASSERT_EQ(10u, copy.size());
+  for (int i=0; i<10; ++i) EXPECT_EQ(i, copy[i]);
+}
+
+// Containers given copies of one allocator share its buffer: the first
+// to spill gets it, and the others go to the heap
+TEST(buffer_allocator, copies_of_allocator_share_buffer) {
+  typedef buffer_allocator<int> allocator_type;
+  int scratch[64];
+  buffer_resource<int> buffer(scratch, 64);
+  const allocator_type a(buffer);
+  small_vector<int, 2, allocator_type> v1(a);
+  small_vector<int, 2, allocator_type> v2(a);
+  EXPECT_TRUE(v1.get_allocator() == v2.get_allocator());
+
+  for (int i=0; i<10; ++i) v1.push_back(i);
+  for (int i=0; i<10; ++i) v2.push_back(100 + i);
+  EXPECT_EQ(scratch, v1.begin());
+  EXPECT_NE(scratch, v2.begin());
+  EXPECT_TRUE(buffer.in_use());
+  for (int i=0; i<10; ++i) EXPECT_EQ(i, v1[i]);
+  for (int i=0; i<10; ++i) EXPECT_EQ(100 + i, v2[i]);
+
+  // Once v1 gives it back, the buffer is free for v2
+  v1.clear();
+  v1.shrink_to_fit();
+  EXPECT_FALSE(buffer.in_use());
+  v2.reserve(40);
+  EXPECT_EQ(scratch, v2.begin());
+  for (int i=0; i<10; ++i) EXPECT_EQ(100 + i, v2[i]);
+}
+
+#if __cplusplus >= 201103L
+#include "spill_cache_allocator.h"
+#include <thread>
+
+// A vector that spills and is destroyed over and over should only go
+// to malloc the first time around
+TEST(spill_cache_allocator, reuses_spill_buffers) {
+  typedef spill_cache_allocator<int, 4> allocator_type;
+  typedef allocator_type::cache_type cache_type;
+  EXPECT_EQ(0u, allocator_type::size_class(8));
+  EXPECT_EQ(2u, allocator_type::size_class(32));
+  EXPECT_EQ(8u, allocator_type::size_class(12));
+
+  const std::size_t before = cache_type::upstream_allocations();
+  for (int round=0; round<100; ++round) {
+    small_vector<int, 4, allocator_type> vec;
+    for (int i=0; i<30; ++i) vec.push_back(i);
+    for (int i=0; i<30; ++i) ASSERT_EQ(i, vec[i]);
+  }
+  // One buffer each for capacities 8, 16 and 32
+  EXPECT_EQ(before + 3, cache_type::upstream_allocations());
+  EXPECT_GE(cache_type::cached_blocks(0), 1u);
+}
+
+// Sizes off the growth sequence bypass the cache
+TEST(spill_cache_allocator, other_sizes) {
+  typedef spill_cache_allocator<int, 4> allocator_type;
+  typedef allocator_type::cache_type cache_type;
+  const std::size_t before = cache_type::upstream_allocations();
+  small_vector<int, 4, allocator_type> vec;
+  vec.reserve(100);
+  vec.push_back(1);
+  EXPECT_EQ(before, cache_type::upstream_allocations());
+}
+
+// Tiny element types are padded up to a pointer
+TEST(spill_cache_allocator, tiny_elements) {
+  small_vector<char, 1, spill_cache_allocator<char, 1> > vec;
+  for (int i=0; i<100; ++i) vec.push_back('a' + i % 26);
+  for (int i=0; i<100; ++i) ASSERT_EQ('a' + i % 26, vec[i]);
+}
+
+// Buffers freed on one thread find their way back to another through
+// the shared depot, and the cache stays bounded
+TEST(spill_cache_allocator, cross_thread_handoff) {
+  typedef spill_cache_allocator<int, 4> allocator_type;
+  typedef allocator_type::cache_type cache_type;
+  allocator_type alloc;
+
+  // Allocate here and free on a consumer thread, which overflows its own
+  // cache into the depot. It has to be one of the largest classes
+  // so that the consumer's cache holds few of them.
+  const std::size_t n = 4 * 2 << 7;
+  int* blocks[64];
+  for (int i=0; i<64; ++i) blocks[i] = alloc.allocate(n);
+  std::thread consumer([&] {
+    for (int i=0; i<64; ++i) alloc.deallocate(blocks[i], n);
+    EXPECT_LE(cache_type::cached_blocks(7), 64u);
+  });
+  consumer.join();
+
+  // Now this thread can get those blocks back without malloc
+  const std::size_t before = cache_type::upstream_allocations();
+  for (int i=0; i<8; ++i) blocks[i] = alloc.allocate(n);
+  EXPECT_EQ(before, cache_type::upstream_allocations());
+  for (int i=0; i<8; ++i) alloc.deallocate(blocks[i], n);
+}
+#endif
@@ -35,3 +35,38 @@ TEST(capacity, no_reallocation) {
     EXPECT_EQ(2u, allocator_type::NumAllocs());
   }
 }
+
+// shrink_to_fit() drops unused heap capacity, and moves the
+// elements back into the small storage when they fit
+TEST(shrink_to_fit, releases_capacity) {
+  typedef allocator_wrapper< std::allocator<int> > allocator_type;
+  allocator_type::NumAllocs() = 0;
+
+  // Nothing to do while small
+  small_vector<int, 4, allocator_type> vec;
+  vec.push_back(1);
+  vec.shrink_to_fit();
+  EXPECT_TRUE(vec.is_small());
+  EXPECT_EQ(4u, vec.capacity());
+
+  // Shrinks to exactly size() on the heap
+  for (int i=2; i<=6; ++i) vec.push_back(i);
+  ASSERT_EQ(8u, vec.capacity());
+  vec.shrink_to_fit();
+  EXPECT_FALSE(vec.is_small());
+  EXPECT_EQ(6u, vec.capacity());
+  EXPECT_EQ(2u, allocator_type::NumAllocs());
+  for (int i=0; i<6; ++i) EXPECT_EQ(i+1, vec[i]);
+
+  // Moves back into the small storage
+  small_vector<int, 4, allocator_type> vec2;
+  vec2.reserve(100);
+  vec2.push_back(1);
+  vec2.push_back(2);
+  vec2.shrink_to_fit();
+  EXPECT_TRUE(vec2.is_small());
+  EXPECT_EQ(4u, vec2.capacity());
+  ASSERT_EQ(2u, vec2.size());
+  EXPECT_EQ(1, vec2[0]);
+  EXPECT_EQ(2, vec2[1]);
+}
@@ -431,3 +431,92 @@ TEST(copy_construct, copies_values) {
   }
 }
 
+
+// Copy assignment replaces the contents, reusing our storage
+// when it is big enough
+TEST(copy_assign, copies_values) {
+  small_vector<int, 4> vsmall(3);
+  for (unsigned i=0; i<vsmall.size(); ++i) vsmall[i] = 2 * i;
+  small_vector<int, 4> vbig(25);
+  for (unsigned i=0; i<vbig.size(); ++i) vbig[i] = 3 * i;
+
+  small_vector<int, 4> v;
+  v = vbig;
+  ASSERT_EQ(vbig.size(), v.size());
+  for (unsigned i=0; i<v.size(); ++i) EXPECT_EQ(vbig[i], v[i]);
+
+  v = vsmall;
+  ASSERT_EQ(vsmall.size(), v.size());
+  EXPECT_EQ(25u, v.capacity());
+  for (unsigned i=0; i<v.size(); ++i) EXPECT_EQ(vsmall[i], v[i]);
+
+  // Self-assignment is a no-op
+  small_vector<int, 4>& alias = v;
+  v = alias;
+  ASSERT_EQ(vsmall.size(), v.size());
+  for (unsigned i=0; i<v.size(); ++i) EXPECT_EQ(vsmall[i], v[i]);
+
+  // Assigning leaves no extra objects behind
+  {
+    MockObjLeakSentry LeakSentry;
+    small_vector<MockObj, 2> m1(5u);
+    small_vector<MockObj, 2> m2(1u, MockObj(7));
+    m1 = m2;
+    ASSERT_EQ(1u, m1.size());
+    EXPECT_EQ(7, m1[0].m_n);
+  }
+}
+
+// Every constructor keeps the allocator it was given
+TEST(allocator, constructors_store_allocator) {
+  typedef tagged_allocator< std::allocator<int> > allocator_type;
+  typedef small_vector<int, 2, allocator_type> vec_type;
+  const allocator_type alloc(7);
+
+  vec_type v1(alloc);
+  EXPECT_EQ(7, v1.get_allocator().tag());
+
+  vec_type v2(5u, alloc);
+  EXPECT_EQ(7, v2.get_allocator().tag());
+  EXPECT_EQ(5u, v2.size());
+
+  vec_type v3(5u, 3, alloc);
+  EXPECT_EQ(7, v3.get_allocator().tag());
+  ASSERT_EQ(5u, v3.size());
+  EXPECT_EQ(3, v3[4]);
+
+  std::list<int> l(4, 1);
+  vec_type v4(l.begin(), l.end(), alloc);
+  EXPECT_EQ(7, v4.get_allocator().tag());
+  EXPECT_EQ(4u, v4.size());
+
+  vec_type v5(v4, allocator_type(8));
+  EXPECT_EQ(8, v5.get_allocator().tag());
+  EXPECT_EQ(4u, v5.size());
+}
+
+// Copies take the allocator that select_on_container_copy_construction
+// gives them: by default the same one
+TEST(allocator, copy_construct) {
+  {
+    typedef tagged_allocator< std::allocator<int> > allocator_type;
+    small_vector<int, 2, allocator_type> v((allocator_type(7)));
+    v.push_back(1);
+
+    small_vector<int, 2, allocator_type> copy(v);
+    EXPECT_EQ(7, copy.get_allocator().tag());
+    small_vector<int, 4, allocator_type> other_size(v);
+    EXPECT_EQ(7, other_size.get_allocator().tag());
+  }
+
+  {
+    typedef fresh_copy_allocator< std::allocator<int> > allocator_type;
+    small_vector<int, 2, allocator_type> v((allocator_type(7)));
+    v.push_back(1);
+
+    small_vector<int, 2, allocator_type> copy(v);
+    EXPECT_EQ(-1, copy.get_allocator().tag());
+    small_vector<int, 4, allocator_type> other_size(v);
+    EXPECT_EQ(-1, other_size.get_allocator().tag());
+  }
+}
@@ -0,0 +1,271 @@
+#include "small_vector.h"
+#include "gtest/gtest.h"
+#include "allocator_wrapper.h"
+#include "instrumentation.h"
+
+#include <iterator>
+#include <sstream>
+
+// Locks in how many allocations and element copies each operation does.
+// Elements are relocated by copying, so spills and reallocations show up
+// as copies.
+
+namespace {
+  typedef allocator_wrapper< std::allocator<probe> > allocator_type;
+  typedef small_vector<probe, 4, allocator_type> vector_type;
+
+  void fill(vector_type& vec, int n) {
+    for (int i=0; i<n; ++i) vec.push_back(probe(i));
+  }
+}
+
+TEST(guarantees, default_construct) {
+  instrumentation::reset();
+  {
+    vector_type vec;
+    EXPECT_NO_WORK();
+  }
+  EXPECT_NO_WORK();
+}
+
+TEST(guarantees, sized_construct) {
+  instrumentation::reset();
+  {
+    vector_type vec(4u, probe(7));
+    EXPECT_ALLOCS(0);
+    EXPECT_COPIES(4);
+  }
+  EXPECT_FREES(0);
+  EXPECT_DESTRUCTIONS(5);
+
+  instrumentation::reset();
+  {
+    vector_type vec(5u, probe(7));
+    EXPECT_ALLOCS(1);
+    EXPECT_BYTES(5 * sizeof(probe));
+    EXPECT_COPIES(5);
+  }
+  EXPECT_FREES(1);
+}
+
+TEST(guarantees, push_back) {
+  vector_type vec;
+  const probe x(1);
+
+  // Into the small storage: one copy, nothing else
+  instrumentation::reset();
+  vec.push_back(x);
+  EXPECT_ALLOCS(0);
+  EXPECT_COPIES(1);
+  fill(vec, 3);
+
+  // The spill relocates the 4 existing elements once
+  instrumentation::reset();
+  vec.push_back(x);
+  EXPECT_ALLOCS(1);
+  EXPECT_FREES(0);
+  EXPECT_COPIES(5);
+  EXPECT_DESTRUCTIONS(4);
+
+  // Then there's room for 3 more without touching anything else
+  instrumentation::reset();
+  for (int i=0; i<3; ++i) vec.push_back(x);
+  EXPECT_ALLOCS(0);
+  EXPECT_COPIES(3);
+
+  // Growing on the heap frees the old buffer
+  instrumentation::reset();
+  vec.push_back(x);
+  EXPECT_ALLOCS(1);
+  EXPECT_FREES(1);
+  EXPECT_COPIES(9);
+}
+
+TEST(guarantees, reserve) {
+  vector_type vec;
+  fill(vec, 3);
+
+  instrumentation::reset();
+  vec.reserve(4);
+  EXPECT_NO_WORK();
+
+  instrumentation::reset();
+  vec.reserve(100);
+  EXPECT_ALLOCS(1);
+  EXPECT_BYTES(100 * sizeof(probe));
+  EXPECT_COPIES(3);
+
+  // Nothing until the reserved room runs out
+  instrumentation::reset();
+  fill(vec, 97);
+  EXPECT_ALLOCS(0);
+  EXPECT_COPIES_LE(97);
+  vec.reserve(50);
+  EXPECT_ALLOCS(0);
+}
+
+TEST(guarantees, copy_construct) {
+  vector_type small;
+  fill(small, 4);
+  instrumentation::reset();
+  {
+    vector_type copy(small);
+    EXPECT_ALLOCS(0);
+    EXPECT_COPIES(4);
+  }
+
+  // Exactly one allocation, sized to fit, and one copy per element
+  vector_type big;
+  fill(big, 9);
+  instrumentation::reset();
+  {
+    vector_type copy(big);
+    EXPECT_ALLOCS(1);
+    EXPECT_BYTES(9 * sizeof(probe));
+    EXPECT_COPIES(9);
+  }
+}
+
+TEST(guarantees, range_construct) {
+  vector_type src;
+  fill(src, 9);
+
+  // Forward iterators are measured first: one allocation
+  instrumentation::reset();
+  {
+    vector_type vec(src.begin(), src.end());
+    EXPECT_ALLOCS(1);
+    EXPECT_COPIES(9);
+  }
+
+  // Input iterators can't be: they grow geometrically, 4 to 8 to 16
+  std::istringstream in("1 2 3 4 5 6 7 8 9");
+  std::istream_iterator<int> first(in), last;
+  instrumentation::reset();
+  small_vector<int, 4, allocator_wrapper< std::allocator<int> > >
+    ints(first, last);
+  EXPECT_EQ(9u, ints.size());
+  EXPECT_ALLOCS(2);
+  EXPECT_FREES(1);
+}
+
+TEST(guarantees, append) {
+  vector_type src;
+  fill(src, 20);
+
+  vector_type vec;
+  fill(vec, 2);
+  instrumentation::reset();
+  vec.append(src.begin(), src.end());
+  EXPECT_ALLOCS(1);
+  EXPECT_COPIES(22);
+}
+
+TEST(guarantees, copy_assign) {
+  vector_type big;
+  fill(big, 9);
+  vector_type vec;
+  fill(vec, 16);
+
+  // Enough capacity: no allocation, and no copies beyond the elements
+  instrumentation::reset();
+  vec = big;
+  EXPECT_ALLOCS(0);
+  EXPECT_FREES(0);
+  EXPECT_COPIES(9);
+  EXPECT_DESTRUCTIONS(16);
+}
+
+TEST(guarantees, access_and_iteration) {
+  vector_type vec;
+  fill(vec, 9);
+  const vector_type& cvec = vec;
+
+  instrumentation::reset();
+  int sum = 0;
+  for (vector_type::const_iterator i = cvec.begin(); i != cvec.end(); ++i) {
+    sum += i->value();
+  }
+  for (vector_type::size_type i=0; i<vec.size(); ++i) {
+    sum += vec[i].value();
+  }
+  EXPECT_EQ(72, sum);
+  EXPECT_EQ(9u, vec.size());
+  EXPECT_LE(9u, vec.capacity());
+  EXPECT_NO_WORK();
+}
+
+TEST(guarantees, clear) {
+  vector_type vec;
+  fill(vec, 9);
+  const vector_type::size_type capacity = vec.capacity();
+
+  instrumentation::reset();
+  vec.clear();
+  EXPECT_ALLOCS(0);
+  EXPECT_FREES(0);
+  EXPECT_COPIES(0);
+  EXPECT_DESTRUCTIONS(9);
+  EXPECT_EQ(capacity, vec.capacity());
+
+  // Refilling up to the old size reuses the buffer
+  instrumentation::reset();
+  fill(vec, 9);
+  EXPECT_ALLOCS(0);
+}
+
+TEST(guarantees, shrink_to_fit) {
+  vector_type vec;
+  fill(vec, 3);
+  instrumentation::reset();
+  vec.shrink_to_fit();
+  EXPECT_NO_WORK();
+
+  // Back into the small storage: no allocation, one free
+  fill(vec, 6);
+  vec.clear();
+  fill(vec, 2);
+  instrumentation::reset();
+  vec.shrink_to_fit();
+  EXPECT_ALLOCS(0);
+  EXPECT_FREES(1);
+  EXPECT_COPIES(2);
+
+  // Already tight on the heap
+  vector_type tight(5u, probe());
+  instrumentation::reset();
+  tight.shrink_to_fit();
+  EXPECT_NO_WORK();
+}
+
+TEST(guarantees, destroy) {
+  instrumentation::reset();
+  {
+    vector_type vec;
+    fill(vec, 4);
+  }
+  EXPECT_ALLOCS(0);
+  EXPECT_FREES(0);
+  EXPECT_DESTRUCTIONS(8);
+
+  instrumentation::reset();
+  {
+    vector_type vec;
+    fill(vec, 5);
+  }
+  EXPECT_FREES(instrumentation::allocs());
+}
+
+TEST(guarantees, grow_uninitialized) {
+  small_vector<int, 8, allocator_wrapper< std::allocator<int> > > vec;
+  instrumentation::reset();
+  int* p = vec.grow_uninitialized(8);
+  for (int i=0; i<8; ++i) p[i] = i;
+  vec.commit(8);
+  EXPECT_ALLOCS(0);
+
+  p = vec.grow_uninitialized(100);
+  vec.commit(0);
+  EXPECT_ALLOCS(1);
+  EXPECT_EQ(8u, vec.size());
+}
@@ -0,0 +1,45 @@
+// Built with the common specializations declared extern, so every use
+// of them here links against small_vector_instantiations.o
+#define SMALLVECTOR_EXTERN_TEMPLATES
+#include "small_vector.h"
+#include "gtest/gtest.h"
+
+namespace {
+  struct point {
+    point() : x(0), y(0) {}
+    point(int x_, int y_) : x(x_), y(y_) {}
+    int x, y;
+  };
+}
+
+// A specialization of our own, instantiated below
+SMALLVECTOR_DECLARE_INSTANTIATION(point, 4)
+
+TEST(instantiations, common_specializations_link) {
+  small_vector<int, 8> ints;
+  for (int i=0; i<20; ++i) ints.push_back(i);
+  small_vector<int, 8> copy(ints);
+  EXPECT_EQ(20u, copy.size());
+  EXPECT_EQ(19, copy[19]);
+  copy.clear();
+  copy.shrink_to_fit();
+  EXPECT_EQ(8u, copy.capacity());
+
+  small_vector<char, 16> chars(3, 'a');
+  const char b[] = "bb";
+  chars.append(b, b + 2);
+  EXPECT_EQ(5u, chars.size());
+  EXPECT_EQ('b', chars[4]);
+
+  small_vector<void*, 4> pointers(10);
+  EXPECT_TRUE(pointers[9] == NULL);
+}
+
+TEST(instantiations, own_specialization_links) {
+  small_vector<point, 4> points;
+  for (int i=0; i<6; ++i) points.push_back(point(i, -i));
+  EXPECT_EQ(6u, points.size());
+  EXPECT_EQ(-5, points[5].y);
+}
+
+SMALLVECTOR_DEFINE_INSTANTIATION(point, 4)
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "gtest/gtest.h"
+
+// Counters for asserting how much work an operation does. Allocations
+// through allocator_wrapper, and special member calls on probe, all count
+// here. Reset the counters, do the operation, then check them:
+//
+//   instrumentation::reset();
+//   vec.push_back(x);
+//   EXPECT_ALLOCS(0);
+//   EXPECT_COPIES(1);
+struct instrumentation {
+  static unsigned& allocs() { static unsigned n; return n; }
+  static unsigned& frees() { static unsigned n; return n; }
+  // Bytes requested from allocate(), not net of frees
+  static unsigned long& bytes() { static unsigned long n; return n; }
+
+  static unsigned& default_constructions() { static unsigned n; return n; }
+  // Constructions from a value, i.e. probe(int)
+  static unsigned& value_constructions() { static unsigned n; return n; }
+  // Copy constructions and copy assignments
+  static unsigned& copies() { static unsigned n; return n; }
+  // Move constructions and move assignments
+  static unsigned& moves() { static unsigned n; return n; }
+  static unsigned& destructions() { static unsigned n; return n; }
+
+  static void reset() {
+    allocs() = 0;
+    frees() = 0;
+    bytes() = 0;
+    default_constructions() = 0;
+    value_constructions() = 0;
+    copies() = 0;
+    moves() = 0;
+    destructions() = 0;
+  }
+};
+
+#define EXPECT_ALLOCS(n) \
+  EXPECT_EQ(static_cast<unsigned>(n), instrumentation::allocs())
+#define EXPECT_FREES(n) \
+  EXPECT_EQ(static_cast<unsigned>(n), instrumentation::frees())
+#define EXPECT_BYTES(n) \
+  EXPECT_EQ(static_cast<unsigned long>(n), instrumentation::bytes())
+#define EXPECT_COPIES(n) \
+  EXPECT_EQ(static_cast<unsigned>(n), instrumentation::copies())
+#define EXPECT_COPIES_LE(n) \
+  EXPECT_LE(instrumentation::copies(), static_cast<unsigned>(n))
+#define EXPECT_MOVES_LE(n) \
+  EXPECT_LE(instrumentation::moves(), static_cast<unsigned>(n))
+#define EXPECT_DESTRUCTIONS(n) \
+  EXPECT_EQ(static_cast<unsigned>(n), instrumentation::destructions())
+// Neither allocates, frees, nor touches any element
+#define EXPECT_NO_WORK() \
+  do { \
+    EXPECT_ALLOCS(0); \
+    EXPECT_FREES(0); \
+    EXPECT_COPIES(0); \
+    EXPECT_MOVES_LE(0); \
+    EXPECT_EQ(0u, instrumentation::default_constructions()); \
+    EXPECT_EQ(0u, instrumentation::value_constructions()); \
+    EXPECT_DESTRUCTIONS(0); \
+  } while (false)
+
+// An element type that counts its special member calls
+class probe {
+public:
+  probe() : m_value(0) { ++instrumentation::default_constructions(); }
+  explicit probe(int value) : m_value(value) {
+    ++instrumentation::value_constructions();
+  }
+  probe(const probe& x) : m_value(x.m_value) { ++instrumentation::copies(); }
+  probe& operator=(const probe& x) {
+    m_value = x.m_value;
+    ++instrumentation::copies();
+    return *this;
+  }
+#if __cplusplus >= 201103L
+  probe(probe&& x) : m_value(x.m_value) { ++instrumentation::moves(); }
+  probe& operator=(probe&& x) {
+    m_value = x.m_value;
+    ++instrumentation::moves();
+    return *this;
+  }
+#endif
+  ~probe() { ++instrumentation::destructions(); }
+
+  int value() const { return m_value; }
+  bool operator==(const probe& rhs) const { return m_value == rhs.m_value; }
+
+private:
+  int m_value;
+};
@@ -0,0 +1,158 @@
+#include "small_vector_io.h"
+#include "allocator_wrapper.h"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace {
+  // Opens a pipe and closes both ends at scope exit
+  class pipe_fds {
+  public:
+    pipe_fds() {
+      if (::pipe(fds) != 0) fds[0] = fds[1] = -1;
+    }
+    ~pipe_fds() {
+      if (fds[0] >= 0) ::close(fds[0]);
+      if (fds[1] >= 0) ::close(fds[1]);
+    }
+    int read_end() const { return fds[0]; }
+    int write_end() const { return fds[1]; }
+  private:
+    int fds[2];
+  };
+}
+
+// read_append() appends what was read after the existing contents,
+// without allocating while the small storage has room
+TEST(read_append, appends_to_tail) {
+  typedef allocator_wrapper< std::allocator<char> > allocator_type;
+  allocator_type::NumAllocs() = 0;
+  pipe_fds p;
+  ASSERT_GE(p.read_end(), 0);
+
+  small_vector<char, 16, allocator_type> vec;
+  vec.push_back('>');
+  ASSERT_EQ(5, ::write(p.write_end(), "hello", 5));
+  EXPECT_EQ(5, read_append(vec, p.read_end(), 8));
+  ASSERT_EQ(6u, vec.size());
+  EXPECT_EQ(0, std::memcmp(vec.begin(), ">hello", 6));
+  EXPECT_EQ(0u, allocator_type::NumAllocs());
+
+  // Spill on the next read
+  ASSERT_EQ(6, ::write(p.write_end(), " world", 6));
+  EXPECT_EQ(6, read_append(vec, p.read_end(), 64));
+  ASSERT_EQ(12u, vec.size());
+  EXPECT_EQ(0, std::memcmp(vec.begin(), ">hello world", 12));
+  EXPECT_EQ(1u, allocator_type::NumAllocs());
+
+  // End of file leaves the vector alone
+  ::close(p.write_end());
+  EXPECT_EQ(0, read_append(vec, p.read_end(), 64));
+  EXPECT_EQ(12u, vec.size());
+}
+
+// Errors leave the vector unchanged and report errno
+TEST(read_append, error) {
+  small_vector<uint8_t, 8> vec;
+  vec.push_back(1);
+  errno = 0;
+  EXPECT_EQ(-1, read_append(vec, -1, 4));
+  EXPECT_EQ(EBADF, errno);
+  EXPECT_EQ(1u, vec.size());
+}
+
+// pread_append() reads at an offset
+TEST(pread_append, reads_at_offset) {
+  char path[] = "/tmp/small_vector_io_XXXXXX";
+  int fd = ::mkstemp(path);
+  ASSERT_GE(fd, 0);
+  ::unlink(path);
+  ASSERT_EQ(10, ::write(fd, "0123456789", 10));
+
+  small_vector<char, 4> vec;
+  EXPECT_EQ(3, pread_append(vec, fd, 3, 4));
+  EXPECT_EQ(3, pread_append(vec, fd, 3, 0));
+  ASSERT_EQ(6u, vec.size());
+  EXPECT_EQ(0, std::memcmp(vec.begin(), "456012", 6));
+  ::close(fd);
+}
+
+// iovec_gather writes several vectors with one writev
+TEST(iovec_gather, write_all) {
+  pipe_fds p;
+  ASSERT_GE(p.read_end(), 0);
+
+  small_vector<char, 4> header;
+  header.push_back('H');
+  header.push_back(':');
+  small_vector<char, 4> empty;
+  small_vector<uint8_t, 2> body;
+  for (int i=0; i<5; ++i) body.push_back('a' + i);
+
+  iovec_gather<> gather;
+  gather.add(header);
+  gather.add(empty);
+  gather.add(body);
+  EXPECT_EQ(2u, gather.size());
+  EXPECT_EQ(7, gather.write_all(p.write_end()));
+  EXPECT_EQ(0u, gather.size());
+
+  small_vector<char, 16> out;
+  EXPECT_EQ(7, read_append(out, p.read_end(), 16));
+  ASSERT_EQ(7u, out.size());
+  EXPECT_EQ(0, std::memcmp(out.begin(), "H:abcde", 7));
+}
+
+// Partial writes pick up where they left off
+TEST(iovec_gather, partial_writes) {
+  pipe_fds p;
+  ASSERT_GE(p.read_end(), 0);
+  ::fcntl(p.write_end(), F_SETFL, O_NONBLOCK);
+  ::fcntl(p.read_end(), F_SETFL, O_NONBLOCK);
+
+  // More than a pipe holds, so writev has to stop part way through
+  // a buffer. Alternate between writing and draining the pipe.
+  small_vector<char, 0> a(100000, 'a');
+  small_vector<char, 0> b(100000, 'b');
+  iovec_gather<> gather;
+  gather.add(a);
+  gather.add(b);
+
+  // The pipe fills part way through, so the first write_all stops
+  // short, reports what went out, and leaves the rest in the gather
+  ssize_t written = gather.write_all(p.write_end());
+  ASSERT_GT(written, 0);
+  ASSERT_LT(written, 200000);
+  ASSERT_GT(gather.size(), 0u);
+  std::size_t left = 0;
+  for (std::size_t i=0; i<gather.size(); ++i) {
+    left += gather.data()[i].iov_len;
+  }
+  EXPECT_EQ(static_cast<std::size_t>(200000 - written), left);
+
+  // With the pipe still full, nothing goes out
+  EXPECT_EQ(-1, gather.write_all(p.write_end()));
+  EXPECT_EQ(EAGAIN, errno);
+
+  small_vector<char, 0> out;
+  while (read_append(out, p.read_end(), 65536) > 0) {}
+  ASSERT_EQ(static_cast<std::size_t>(written), out.size());
+
+  // Keep going until everything is through
+  while (gather.size() > 0) {
+    const ssize_t n = gather.write_all(p.write_end());
+    if (n < 0) {
+      ASSERT_EQ(EAGAIN, errno);
+    } else {
+      written += n;
+    }
+    while (read_append(out, p.read_end(), 65536) > 0) {}
+  }
+  EXPECT_EQ(200000, written);
+  while (read_append(out, p.read_end(), 65536) > 0) {}
+  ASSERT_EQ(200000u, out.size());
+  for (unsigned i=0; i<100000; ++i) ASSERT_EQ('a', out[i]);
+  for (unsigned i=100000; i<200000; ++i) ASSERT_EQ('b', out[i]);
+}
@@ -1,6 +1,10 @@
 #include "small_vector.h"
 #include "allocator_wrapper.h"
 #include "gtest/gtest.h"
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <sstream>
 
 // 23.3.6.5
 // Causes reallocation if the new size is greater than the old capacity
@@ -27,3 +31,247 @@ TEST(push_back, reallocation) {
   EXPECT_EQ(1u, allocator_type::NumAllocs());
   for (int i=0; i<5; ++i) EXPECT_EQ(i+1, vec[i]);
 }
+
+// Appending a multi-pass range should allocate at most once
+TEST(append, forward_range_one_alloc) {
+  typedef allocator_wrapper< std::allocator<int> > allocator_type;
+  allocator_type::NumAllocs() = 0;
+  small_vector<int, 4, allocator_type> vec;
+  vec.push_back(0);
+
+  std::list<int> l;
+  for (int i=1; i<20; ++i) l.push_back(i);
+  vec.append(l.begin(), l.end());
+
+  EXPECT_EQ(20u, vec.size());
+  EXPECT_EQ(1u, allocator_type::NumAllocs());
+  for (int i=0; i<20; ++i) EXPECT_EQ(i, vec[i]);
+}
+
+// Many small appends grow the capacity geometrically rather than to
+// exactly what each one needs
+TEST(append, repeated_small_ranges) {
+  typedef allocator_wrapper< std::allocator<int> > allocator_type;
+  allocator_type::NumAllocs() = 0;
+  small_vector<int, 4, allocator_type> vec;
+  const int pair[] = {1, 2};
+  for (int i=0; i<1000; ++i) vec.append(pair, pair + 2);
+
+  EXPECT_EQ(2000u, vec.size());
+  EXPECT_LE(allocator_type::NumAllocs(), 10u);
+}
+
+// The same with a size hint, which makes room up front but still grows
+// geometrically
+TEST(append, repeated_small_ranges_hinted) {
+  typedef allocator_wrapper< std::allocator<int> > allocator_type;
+  allocator_type::NumAllocs() = 0;
+  small_vector<int, 4, allocator_type> vec;
+  const int pair[] = {1, 2};
+  for (int i=0; i<1000; ++i) vec.append(pair, pair + 2, 2);
+
+  EXPECT_EQ(2000u, vec.size());
+  EXPECT_LE(allocator_type::NumAllocs(), 10u);
+}
+
+// A vector on the heap can append its own elements, even when that
+// reallocates
+TEST(append, own_elements) {
+  small_vector<int, 4> vec;
+  for (int i=0; i<5; ++i) vec.push_back(i);
+  ASSERT_FALSE(vec.is_small());
+  vec.shrink_to_fit();
+  ASSERT_EQ(vec.size(), vec.capacity());
+
+  vec.append(vec.begin(), vec.end());
+  ASSERT_EQ(10u, vec.size());
+  for (int i=0; i<10; ++i) EXPECT_EQ(i % 5, vec[i]);
+
+  const small_vector<int, 4>& c = vec;
+  vec.shrink_to_fit();
+  vec.append(c.begin() + 8, c.end());
+  ASSERT_EQ(12u, vec.size());
+  EXPECT_EQ(3, vec[10]);
+  EXPECT_EQ(4, vec[11]);
+}
+
+// Appending a single-pass range grows geometrically, and
+// never allocates while there is capacity left
+TEST(append, input_range) {
+  typedef allocator_wrapper< std::allocator<int> > allocator_type;
+  typedef std::istream_iterator<int> iterator;
+
+  // Fits in the small storage
+  {
+    allocator_type::NumAllocs() = 0;
+    std::istringstream in("1 2 3");
+    small_vector<int, 4, allocator_type> vec;
+    vec.append(iterator(in), iterator());
+    EXPECT_EQ(3u, vec.size());
+    EXPECT_EQ(0u, allocator_type::NumAllocs());
+    for (int i=0; i<3; ++i) EXPECT_EQ(i+1, vec[i]);
+  }
+
+  // Spills: 4 -> 8 -> 16
+  {
+    allocator_type::NumAllocs() = 0;
+    std::istringstream in("1 2 3 4 5 6 7 8 9 10 11 12");
+    small_vector<int, 4, allocator_type> vec;
+    vec.append(iterator(in), iterator());
+    EXPECT_EQ(12u, vec.size());
+    EXPECT_EQ(2u, allocator_type::NumAllocs());
+    for (int i=0; i<12; ++i) EXPECT_EQ(i+1, vec[i]);
+  }
+}
+
+// A size hint reserves up front, so an accurate hint means
+// at most one allocation even for single-pass ranges
+TEST(append, size_hint) {
+  typedef allocator_wrapper< std::allocator<int> > allocator_type;
+  typedef std::istream_iterator<int> iterator;
+
+  // Exact hint
+  {
+    allocator_type::NumAllocs() = 0;
+    std::istringstream in("1 2 3 4 5 6 7 8 9 10 11 12");
+    small_vector<int, 4, allocator_type> vec;
+    vec.append(iterator(in), iterator(), 12);
+    EXPECT_EQ(12u, vec.size());
+    EXPECT_EQ(12u, vec.capacity());
+    EXPECT_EQ(1u, allocator_type::NumAllocs());
+    for (int i=0; i<12; ++i) EXPECT_EQ(i+1, vec[i]);
+  }
+
+  // Hint too small: reserve, then keep growing as usual
+  {
+    allocator_type::NumAllocs() = 0;
+    std::istringstream in("1 2 3 4 5 6 7 8 9 10 11 12");
+    small_vector<int, 4, allocator_type> vec;
+    vec.append(iterator(in), iterator(), 6);
+    EXPECT_EQ(12u, vec.size());
+    EXPECT_EQ(2u, allocator_type::NumAllocs());
+    for (int i=0; i<12; ++i) EXPECT_EQ(i+1, vec[i]);
+  }
+}
+
+// reserve() only ever grows the capacity
+TEST(reserve, grows_capacity) {
+  typedef allocator_wrapper< std::allocator<int> > allocator_type;
+  allocator_type::NumAllocs() = 0;
+  small_vector<int, 4, allocator_type> vec;
+  vec.push_back(1);
+
+  vec.reserve(2);
+  EXPECT_EQ(4u, vec.capacity());
+  EXPECT_TRUE(vec.is_small());
+  EXPECT_EQ(0u, allocator_type::NumAllocs());
+
+  vec.reserve(10);
+  EXPECT_EQ(10u, vec.capacity());
+  EXPECT_FALSE(vec.is_small());
+  EXPECT_EQ(1u, allocator_type::NumAllocs());
+  ASSERT_EQ(1u, vec.size());
+  EXPECT_EQ(1, vec[0]);
+}
+
+// grow_uninitialized() hands out writable slots at the end, and
+// commit() publishes however many of them were filled
+TEST(grow_uninitialized, commit) {
+  typedef allocator_wrapper< std::allocator<int> > allocator_type;
+  allocator_type::NumAllocs() = 0;
+  small_vector<int, 4, allocator_type> vec;
+  vec.push_back(0);
+
+  // Fits in the remaining small storage
+  int* p = vec.grow_uninitialized(3);
+  EXPECT_EQ(vec.end(), p);
+  EXPECT_EQ(1u, vec.size());
+  EXPECT_EQ(0u, allocator_type::NumAllocs());
+  const int first[] = {1, 2, 3};
+  std::memcpy(p, first, sizeof(first));
+  vec.commit(3);
+  EXPECT_EQ(4u, vec.size());
+  EXPECT_TRUE(vec.is_small());
+
+  // Needs to spill. Only commit part of what was reserved.
+  p = vec.grow_uninitialized(10);
+  EXPECT_EQ(1u, allocator_type::NumAllocs());
+  EXPECT_GE(vec.capacity(), 14u);
+  EXPECT_EQ(vec.end(), p);
+  for (int i=0; i<5; ++i) p[i] = 4 + i;
+  vec.commit(5);
+  ASSERT_EQ(9u, vec.size());
+  for (int i=0; i<9; ++i) EXPECT_EQ(i, vec[i]);
+
+  // The uncommitted slots are still available
+  p = vec.grow_uninitialized(5);
+  EXPECT_EQ(1u, allocator_type::NumAllocs());
+  vec.commit(0);
+  EXPECT_EQ(9u, vec.size());
+}
+
+// clear() destroys the elements but keeps the capacity
+TEST(clear, keeps_capacity) {
+  small_vector<int, 2> vec;
+  for (int i=0; i<5; ++i) vec.push_back(i);
+  const std::size_t capacity = vec.capacity();
+  vec.clear();
+  EXPECT_TRUE(vec.empty());
+  EXPECT_EQ(capacity, vec.capacity());
+  vec.push_back(7);
+  ASSERT_EQ(1u, vec.size());
+  EXPECT_EQ(7, vec[0]);
+}
+
+// Inserting shifts the later elements up, growing if full
+TEST(insert, shifts_and_grows) {
+  small_vector<int, 4> vec;
+  vec.insert(vec.end(), 3);
+  vec.insert(vec.begin(), 1);
+  vec.insert(vec.begin() + 1, 2);
+  vec.insert(vec.end(), 5);
+  EXPECT_TRUE(vec.is_small());
+
+  small_vector<int, 4>::iterator i = vec.insert(vec.begin() + 3, 4);
+  EXPECT_FALSE(vec.is_small());
+  EXPECT_EQ(4, *i);
+  ASSERT_EQ(5u, vec.size());
+  for (int k=0; k<5; ++k) EXPECT_EQ(k+1, vec[k]);
+}
+
+// Inserting one of the vector's own elements inserts its old value
+TEST(insert, own_element) {
+  small_vector<int, 8> vec;
+  for (int i=0; i<4; ++i) vec.push_back(i);
+  vec.insert(vec.begin(), vec[2]);
+  const int expected[] = { 2, 0, 1, 2, 3 };
+  ASSERT_EQ(5u, vec.size());
+  for (int k=0; k<5; ++k) EXPECT_EQ(expected[k], vec[k]);
+
+  // And when the insert reallocates
+  small_vector<int, 2> full;
+  full.push_back(7);
+  full.push_back(8);
+  full.insert(full.begin(), full[1]);
+  EXPECT_EQ(8, full[0]);
+  EXPECT_EQ(7, full[1]);
+  EXPECT_EQ(8, full[2]);
+}
+
+TEST(erase, shifts_down) {
+  small_vector<int, 4> vec;
+  for (int i=0; i<6; ++i) vec.push_back(i);
+  small_vector<int, 4>::iterator i = vec.erase(vec.begin() + 1);
+  EXPECT_EQ(2, *i);
+  i = vec.erase(vec.begin() + 2, vec.begin() + 4);
+  EXPECT_EQ(5, *i);
+  ASSERT_EQ(3u, vec.size());
+  EXPECT_EQ(0, vec[0]);
+  EXPECT_EQ(2, vec[1]);
+  EXPECT_EQ(5, vec[2]);
+  EXPECT_EQ(vec.end(), vec.erase(vec.end(), vec.end()));
+
+  vec.pop_back();
+  ASSERT_EQ(2u, vec.size());
+  EXPECT_EQ(2, vec[1]);
+}
@@ -0,0 +1,68 @@
+#define SMALLVECTOR_USDT
+
+#include "small_vector.h"
+#include "gtest/gtest.h"
+
+#if defined(__x86_64__) && defined(__ELF__)
+#include <elf.h>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+  // The small_vector probe names in this binary's .note.stapsdt section
+  std::set<std::string> probe_names() {
+    std::ifstream in("/proc/self/exe", std::ios::binary);
+    const std::vector<char> image((std::istreambuf_iterator<char>(in)),
+                                  std::istreambuf_iterator<char>());
+    const char* base = &image[0];
+    const Elf64_Ehdr* ehdr = reinterpret_cast<const Elf64_Ehdr*>(base);
+    const Elf64_Shdr* shdrs =
+      reinterpret_cast<const Elf64_Shdr*>(base + ehdr->e_shoff);
+    const char* names = base + shdrs[ehdr->e_shstrndx].sh_offset;
+
+    std::set<std::string> probes;
+    for (int i=0; i<ehdr->e_shnum; ++i) {
+      if (std::string(names + shdrs[i].sh_name) != ".note.stapsdt") {
+        continue;
+      }
+      const char* p = base + shdrs[i].sh_offset;
+      const char* end = p + shdrs[i].sh_size;
+      while (p < end) {
+        const Elf64_Nhdr* nhdr = reinterpret_cast<const Elf64_Nhdr*>(p);
+        const char* desc = p + sizeof(*nhdr) + ((nhdr->n_namesz + 3) & ~3);
+        // Location, base and semaphore, then provider, name and arguments
+        const char* provider = desc + 3 * 8;
+        const char* name = provider + std::string(provider).size() + 1;
+        if (std::string(provider) == "small_vector") {
+          probes.insert(name);
+        }
+        p = desc + ((nhdr->n_descsz + 3) & ~3);
+      }
+    }
+    return probes;
+  }
+}
+
+TEST(probes, notes) {
+  const std::set<std::string> probes = probe_names();
+  EXPECT_EQ(1u, probes.count("spill"));
+  EXPECT_EQ(1u, probes.count("grow"));
+  EXPECT_EQ(1u, probes.count("shrink"));
+}
+#endif
+
+// The probes are nops, and don't disturb the vector
+TEST(probes, paths) {
+  small_vector<int, 2> v;
+  for (int i=0; i<9; ++i) v.push_back(i);
+  EXPECT_EQ(9u, v.size());
+  EXPECT_EQ(8, v[8]);
+  v.reserve(100);
+  EXPECT_EQ(100u, v.capacity());
+  v.clear();
+  v.shrink_to_fit();
+  EXPECT_TRUE(v.is_small());
+}
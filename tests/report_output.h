@@ -0,0 +1,28 @@
+#pragma once
+
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <string>
+
+// What report(f) writes to a file, e.g. small_vector_stats::dump, read
+// back from a temporary file. Empty if no temporary file can be made.
+inline std::string report_output(void (*report)(std::FILE*)) {
+  std::string text;
+  std::FILE* f = std::tmpfile();
+  if (!f) {
+    return text;
+  }
+  report(f);
+  std::rewind(f);
+  char buf[4096];
+  std::size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) {
+    text.append(buf, n);
+  }
+  std::fclose(f);
+  return text;
+}
+
+// Checks that text contains s, printing text if it doesn't
+#define EXPECT_CONTAINS(text, s) \
+  EXPECT_NE(std::string::npos, std::string(text).find(s)) << (text)
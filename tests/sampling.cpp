@@ -0,0 +1,86 @@
+// Sampling needs C++11; in C++03 this file tests nothing
+#if __cplusplus >= 201103L
+#define SMALLVECTOR_SAMPLING
+#endif
+
+#include "small_vector.h"
+#include "gtest/gtest.h"
+#include "report_output.h"
+#include <string>
+
+#ifdef SMALLVECTOR_SAMPLING
+#include <thread>
+
+namespace {
+  // Unique element types, so that no other test touches their totals
+  struct sampled_elem { int n; };
+  struct sampled_elem2 { int n; };
+  struct sampled_elem3 { int n; };
+}
+
+TEST(sampling, every_vector) {
+  small_vector_sampling::set_sample_period(1);
+  const sampled_elem e = { 1 };
+  {
+    small_vector<sampled_elem, 2> a;
+    a.push_back(e);
+
+    // Spills to 4, then grows to 8
+    small_vector<sampled_elem, 2> b;
+    for (int i=0; i<5; ++i) b.push_back(e);
+  }
+  EXPECT_EQ(4u, small_vector_sampling::drain());
+
+  const small_vector_sampling::totals t =
+    small_vector_sampling::totals_for<sampled_elem, 2>();
+  EXPECT_EQ(2u, t.sampled);
+  EXPECT_EQ(1u, t.spills);
+  EXPECT_EQ(1u, t.grow_steps);
+  EXPECT_EQ(5u, t.peak_size);
+  EXPECT_EQ(0u, small_vector_sampling::drain());
+}
+
+// A new thread samples its first vector, then every k-th
+TEST(sampling, one_in_k) {
+  small_vector_sampling::set_sample_period(4);
+  std::thread([] {
+    for (int i=0; i<100; ++i) {
+      small_vector<sampled_elem2, 2> v;
+    }
+  }).join();
+  small_vector_sampling::drain();
+  EXPECT_EQ(25u,
+            (small_vector_sampling::totals_for<sampled_elem2, 2>().sampled));
+  small_vector_sampling::set_sample_period(1024);
+}
+
+TEST(sampling, full_buffer_drops) {
+  small_vector_sampling::set_sample_period(1);
+  const small_vector_sampling::counter_type dropped =
+    small_vector_sampling::dropped();
+  small_vector_sampling::drain();
+  for (std::size_t i=0; i<small_vector_sampling::buffer_capacity + 10; ++i) {
+    small_vector<sampled_elem3, 2> v;
+  }
+  EXPECT_EQ(dropped + 10, small_vector_sampling::dropped());
+  const std::size_t capacity = small_vector_sampling::buffer_capacity;
+  EXPECT_EQ(capacity, small_vector_sampling::drain());
+  small_vector_sampling::set_sample_period(1024);
+}
+
+TEST(sampling, reporter) {
+  small_vector_sampling::set_sample_period(1);
+  {
+    small_vector_sample_reporter reporter(std::chrono::milliseconds(1));
+    small_vector<sampled_elem, 2> v;
+  }
+  // The reporter drained on the way out
+  EXPECT_EQ(0u, small_vector_sampling::drain());
+  small_vector_sampling::set_sample_period(1024);
+
+  const std::string out = report_output(&small_vector_sampling::report);
+  EXPECT_CONTAINS(out, "sampled_elem");
+  EXPECT_CONTAINS(out, "est. total");
+}
+
+#endif
@@ -0,0 +1,103 @@
+// The site histograms need C++11; in C++03 this file tests nothing
+#if __cplusplus >= 201103L
+#define SMALLVECTOR_SITES
+#endif
+
+#include "small_vector.h"
+#include "gtest/gtest.h"
+#include "report_output.h"
+#include <cstring>
+#include <string>
+
+#ifdef SMALLVECTOR_SITES
+
+namespace {
+  // Unique element types, so that no other test touches their sites
+  struct sites_elem { int n; };
+  struct sites_elem2 { int n; };
+
+  const sites_elem e = { 1 };
+
+  // All of these vectors come from the same site
+  unsigned fill_line;
+  void fill(::std::size_t n) {
+    fill_line = __LINE__ + 1;
+    small_vector<sites_elem, 4> v;
+    for (::std::size_t i=0; i<n; ++i) v.push_back(e);
+  }
+
+  template <class T>
+  const small_vector_sites::site_record* find_site(unsigned line) {
+    for (const small_vector_sites::site_record* s =
+           small_vector_sites::first(); s; s = s->next()) {
+      if (s->line() == line && s->element_size() == sizeof(T) &&
+          std::strstr(s->element_type(), "sites_elem")) {
+        return s;
+      }
+    }
+    return NULL;
+  }
+}
+
+TEST(sites, buckets) {
+  EXPECT_EQ(0u, small_vector_sites::bucket_of(0));
+  EXPECT_EQ(1u, small_vector_sites::bucket_of(1));
+  EXPECT_EQ(2u, small_vector_sites::bucket_of(2));
+  EXPECT_EQ(3u, small_vector_sites::bucket_of(3));
+  EXPECT_EQ(3u, small_vector_sites::bucket_of(4));
+  EXPECT_EQ(4u, small_vector_sites::bucket_of(5));
+  EXPECT_EQ(0u, small_vector_sites::bucket_limit(0));
+  EXPECT_EQ(1u, small_vector_sites::bucket_limit(1));
+  EXPECT_EQ(4u, small_vector_sites::bucket_limit(3));
+  EXPECT_EQ(8u, small_vector_sites::bucket_limit(4));
+}
+
+TEST(sites, histogram) {
+  small_vector_sites::report_at_exit(false);
+
+  // 90 vectors of 3 elements, 9 of 6, and 1 of 40
+  for (int i=0; i<90; ++i) fill(3);
+  for (int i=0; i<9; ++i) fill(6);
+  fill(40);
+
+  const small_vector_sites::site_record* s = find_site<sites_elem>(fill_line);
+  ASSERT_TRUE(s != NULL);
+  EXPECT_CONTAINS(s->file(), "sites.cpp");
+  EXPECT_EQ(4u, s->small_size());
+  EXPECT_EQ(100u, s->vectors());
+  EXPECT_EQ(10u, s->spilled());
+  EXPECT_EQ(90u, s->bucket(small_vector_sites::bucket_of(3)));
+  EXPECT_EQ(9u, s->bucket(small_vector_sites::bucket_of(6)));
+  EXPECT_EQ(1u, s->bucket(small_vector_sites::bucket_of(40)));
+  EXPECT_EQ(4u, s->size_covering(0.90));
+  EXPECT_EQ(8u, s->size_covering(0.99));
+  EXPECT_EQ(64u, s->size_covering(1.0));
+}
+
+// Each constructor records its own caller, and the largest size counts
+// even if the vector was cleared before being destroyed
+TEST(sites, per_site) {
+  const unsigned line1 = __LINE__ + 1;
+  { small_vector<sites_elem2, 2> a(5u, sites_elem2()); a.clear(); }
+  const unsigned line2 = __LINE__ + 1;
+  { small_vector<sites_elem2, 2> b; }
+
+  const small_vector_sites::site_record* s1 = find_site<sites_elem2>(line1);
+  const small_vector_sites::site_record* s2 = find_site<sites_elem2>(line2);
+  ASSERT_TRUE(s1 != NULL);
+  ASSERT_TRUE(s2 != NULL);
+  EXPECT_NE(s1, s2);
+  EXPECT_EQ(1u, s1->vectors());
+  EXPECT_EQ(1u, s1->spilled());
+  EXPECT_EQ(1u, s1->bucket(small_vector_sites::bucket_of(5)));
+  EXPECT_EQ(1u, s2->vectors());
+  EXPECT_EQ(1u, s2->bucket(0));
+}
+
+TEST(sites, report) {
+  const std::string out = report_output(&small_vector_sites::report);
+  EXPECT_CONTAINS(out, "sites.cpp:");
+  EXPECT_CONTAINS(out, "p99 N");
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include "small_flat_map.h"
+#include "gtest/gtest.h"
+#include "allocator_wrapper.h"
+#include "instrumentation.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Counts every operator new in this test, to catch temporary buffers
+// that don't come from the map's allocator
+namespace {
+  unsigned long NumNews = 0;
+}
+
+void* operator new(std::size_t n) {
+  ++NumNews;
+  void* p = std::malloc(n ? n : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) throw() {
+  std::free(p);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void* p, std::size_t) throw() {
+  std::free(p);
+}
+#endif
+
+namespace {
+  typedef std::pair<int, int> entry;
+  typedef allocator_wrapper< std::allocator<entry> > allocator_type;
+  typedef small_flat_map<int, int, 4, std::less<int>, allocator_type>
+    map_type;
+
+  // Orders std::strings, and compares them with const char* without
+  // making a std::string
+  struct string_less {
+    typedef void is_transparent;
+    bool operator()(const std::string& a, const std::string& b) const {
+      return a < b;
+    }
+    bool operator()(const std::string& a, const char* b) const {
+      return std::strcmp(a.c_str(), b) < 0;
+    }
+    bool operator()(const char* a, const std::string& b) const {
+      return std::strcmp(a, b.c_str()) < 0;
+    }
+  };
+
+  bool greater(int a, int b) {
+    return a > b;
+  }
+
+  std::vector<int> keys(const map_type& m) {
+    std::vector<int> k;
+    for (map_type::const_iterator i = m.begin(); i != m.end(); ++i) {
+      k.push_back(i->first);
+    }
+    return k;
+  }
+}
+
+// Up to SmallSize entries stay in the object, kept sorted
+TEST(small_flat_map, small_maps_stay_inline) {
+  instrumentation::reset();
+  {
+    map_type m;
+    EXPECT_TRUE(m.insert(entry(3, 30)).second);
+    EXPECT_TRUE(m.insert(entry(1, 10)).second);
+    EXPECT_TRUE(m.insert(entry(4, 40)).second);
+    m[2] = 20;
+    EXPECT_EQ(4u, m.size());
+    EXPECT_TRUE(m.is_small());
+    const int expected[] = { 1, 2, 3, 4 };
+    EXPECT_EQ(std::vector<int>(expected, expected + 4), keys(m));
+    EXPECT_EQ(20, m.find(2)->second);
+    EXPECT_TRUE(m.find(5) == m.end());
+  }
+  EXPECT_ALLOCS(0);
+}
+
+// Inserting an existing key keeps the old value
+TEST(small_flat_map, insert_existing) {
+  map_type m;
+  m.insert(entry(1, 10));
+  const std::pair<map_type::iterator, bool> r = m.insert(entry(1, 11));
+  EXPECT_FALSE(r.second);
+  EXPECT_EQ(10, r.first->second);
+  EXPECT_EQ(1u, m.size());
+  m[1] = 12;
+  EXPECT_EQ(12, m.find(1)->second);
+  EXPECT_EQ(1u, m.size());
+}
+
+// Lookups give the same answers before and after the map spills
+TEST(small_flat_map, lookup_after_spill) {
+  map_type m;
+  for (int i = 20; i > 0; --i) {
+    m[2 * i] = i;
+  }
+  EXPECT_FALSE(m.is_small());
+  EXPECT_EQ(20u, m.size());
+  for (int i = 1; i <= 20; ++i) {
+    EXPECT_EQ(1u, m.count(2 * i));
+    EXPECT_EQ(0u, m.count(2 * i + 1));
+    EXPECT_EQ(i, m.find(2 * i)->second);
+    EXPECT_EQ(2 * i + 2, m.lower_bound(2 * i + 1) == m.end() ? 42 :
+                         m.lower_bound(2 * i + 1)->first);
+  }
+  EXPECT_TRUE(m.lower_bound(0) == m.begin());
+}
+
+TEST(small_flat_map, erase) {
+  map_type m;
+  for (int i = 0; i < 6; ++i) {
+    m[i] = i;
+  }
+  EXPECT_EQ(1u, m.erase(2));
+  EXPECT_EQ(0u, m.erase(2));
+  map_type::iterator next = m.erase(m.find(4));
+  EXPECT_EQ(5, next->first);
+  const int expected[] = { 0, 1, 3, 5 };
+  EXPECT_EQ(std::vector<int>(expected, expected + 4), keys(m));
+  m.clear();
+  EXPECT_TRUE(m.empty());
+}
+
+// A bulk insert allocates at most once, keeps existing values over new
+// ones and the first of repeated new keys, and leaves the map sorted
+TEST(small_flat_map, bulk_insert) {
+  map_type m;
+  m[5] = 50;
+  m[1] = 10;
+  const entry more[] = { entry(9, 90), entry(5, 51), entry(3, 30),
+                         entry(7, 70), entry(3, 31), entry(0, 0) };
+  instrumentation::reset();
+  m.insert(more, more + 6);
+  EXPECT_ALLOCS(1);
+  const int expected[] = { 0, 1, 3, 5, 7, 9 };
+  EXPECT_EQ(std::vector<int>(expected, expected + 6), keys(m));
+  EXPECT_EQ(50, m.find(5)->second);
+  EXPECT_EQ(30, m.find(3)->second);
+
+  const map_type copy(more, more + 6);
+  const int copy_keys[] = { 0, 3, 5, 7, 9 };
+  EXPECT_EQ(std::vector<int>(copy_keys, copy_keys + 5), keys(copy));
+  EXPECT_EQ(51, copy.find(5)->second);
+}
+
+// A bulk insert that fits in the small storage sorts in place, and
+// keys already present never make it spill
+TEST(small_flat_map, bulk_insert_stays_inline) {
+  typedef small_flat_map<int, int, 8, std::less<int>, allocator_type>
+    eight_type;
+  instrumentation::reset();
+  NumNews = 0;
+  {
+    eight_type m;
+    const entry first[] = { entry(3, 30), entry(1, 10), entry(2, 20) };
+    m.insert(first, first + 3);
+    EXPECT_TRUE(m.is_small());
+
+    const entry more[] = { entry(6, 60), entry(1, 11), entry(5, 50),
+                           entry(2, 21), entry(4, 40), entry(3, 31) };
+    m.insert(more, more + 6);
+    const unsigned long news = NumNews;
+    EXPECT_EQ(0u, news);
+    EXPECT_EQ(6u, m.size());
+    EXPECT_TRUE(m.is_small());
+    const int expected[] = { 1, 2, 3, 4, 5, 6 };
+    std::vector<int> k;
+    for (eight_type::const_iterator i = m.begin(); i != m.end(); ++i) {
+      k.push_back(i->first);
+    }
+    EXPECT_EQ(std::vector<int>(expected, expected + 6), k);
+    EXPECT_EQ(10, m.find(1)->second);
+    EXPECT_EQ(30, m.find(3)->second);
+  }
+  EXPECT_ALLOCS(0);
+}
+
+// Keys repeated within a range can spill it; once they are dropped the
+// map moves back into the small storage
+TEST(small_flat_map, bulk_insert_moves_back_inline) {
+  const entry repeats[] = { entry(2, 20), entry(1, 10), entry(2, 21),
+                            entry(1, 11), entry(2, 22), entry(3, 30) };
+  map_type m(repeats, repeats + 6);
+  EXPECT_EQ(3u, m.size());
+  EXPECT_TRUE(m.is_small());
+  EXPECT_EQ(20, m.find(2)->second);
+  EXPECT_EQ(10, m.find(1)->second);
+}
+
+// With a transparent comparison, lookups take other key types
+TEST(small_flat_map, heterogeneous_lookup) {
+  typedef small_flat_map<std::string, int, 2, string_less> names_type;
+  names_type m;
+  m[std::string("one")] = 1;
+  m[std::string("two")] = 2;
+  EXPECT_EQ(1, m.find("one")->second);
+  EXPECT_EQ(0u, m.count("three"));
+  m[std::string("three")] = 3;
+  EXPECT_FALSE(m.is_small());
+  EXPECT_EQ(3, m.find("three")->second);
+  EXPECT_EQ(1u, m.count("two"));
+  EXPECT_EQ("two", m.lower_bound("tk")->first);
+}
+
+// Like std::map, the comparison can be a function pointer
+TEST(small_flat_map, function_pointer_compare) {
+  typedef small_flat_map<int, int, 2, bool (*)(int, int)> reversed_type;
+  reversed_type m(&greater);
+  const entry values[] = { entry(1, 10), entry(3, 30), entry(2, 20) };
+  m.insert(values, values + 3);
+  EXPECT_FALSE(m.is_small());
+  std::vector<int> k;
+  for (reversed_type::const_iterator i = m.begin(); i != m.end(); ++i) {
+    k.push_back(i->first);
+  }
+  const int expected[] = { 3, 2, 1 };
+  EXPECT_EQ(std::vector<int>(expected, expected + 3), k);
+  EXPECT_EQ(20, m.find(2)->second);
+  EXPECT_TRUE(m.key_comp() == &greater);
+}
@@ -0,0 +1,113 @@
+#include "small_string.h"
+#include "gtest/gtest.h"
+#include "allocator_wrapper.h"
+#include "instrumentation.h"
+
+#include <cstring>
+#include <string>
+
+namespace {
+  typedef allocator_wrapper< std::allocator<char> > allocator_type;
+  typedef small_string<7, allocator_type> string_type;
+}
+
+// Up to SmallSize chars and the terminator stay in the object
+TEST(small_string, short_strings_stay_inline) {
+  instrumentation::reset();
+  {
+    string_type s("abc");
+    s += "defg";
+    EXPECT_EQ(7u, s.size());
+    EXPECT_EQ(7u, s.capacity());
+    EXPECT_TRUE(s.is_small());
+    EXPECT_STREQ("abcdefg", s.c_str());
+    s.clear();
+    EXPECT_TRUE(s.empty());
+    EXPECT_STREQ("", s.c_str());
+  }
+  EXPECT_ALLOCS(0);
+}
+
+// One more char spills, and c_str() is still terminated without
+// another allocation
+TEST(small_string, spills_once) {
+  instrumentation::reset();
+  string_type s("abcdefg");
+  s.push_back('h');
+  EXPECT_FALSE(s.is_small());
+  EXPECT_ALLOCS(1);
+  EXPECT_STREQ("abcdefgh", s.c_str());
+  EXPECT_EQ(8u, std::strlen(s.c_str()));
+  EXPECT_ALLOCS(1);
+}
+
+TEST(small_string, construct) {
+  const string_type a(3, 'x');
+  EXPECT_STREQ("xxx", a.c_str());
+  const string_type b("hello world", 5);
+  EXPECT_EQ("hello", b);
+  const string_type c(std::string("from std::string"));
+  EXPECT_EQ(std::string("from std::string"), c.str());
+  string_type d(c);
+  EXPECT_EQ(c, d);
+  d = a;
+  EXPECT_EQ(a, d);
+}
+
+// Appending part of the string to itself survives the reallocation
+TEST(small_string, self_append) {
+  string_type s("abcdef");
+  s.append(s.data() + 1, 4);
+  EXPECT_STREQ("abcdefbcde", s.c_str());
+  s.append(s);
+  EXPECT_STREQ("abcdefbcdeabcdefbcde", s.c_str());
+}
+
+TEST(small_string, find) {
+  const string_type s("key=value;key2=v");
+  EXPECT_EQ(3u, s.find('='));
+  EXPECT_EQ(14u, s.find('=', 4));
+  EXPECT_EQ(string_type::npos, s.find('#'));
+  EXPECT_EQ(0u, s.find("key"));
+  EXPECT_EQ(10u, s.find("key", 1));
+  EXPECT_EQ(10u, s.find("key2"));
+  EXPECT_EQ(string_type::npos, s.find("key3"));
+  EXPECT_EQ(string_type::npos, s.find("v;key2=v!"));
+  EXPECT_EQ(5u, s.find("", 5));
+  EXPECT_EQ(string_type::npos, s.find('k', 100));
+}
+
+TEST(small_string, compare) {
+  const small_string<4> a("abc"), b("abd"), c("ab");
+  EXPECT_LT(a.compare(b), 0);
+  EXPECT_GT(a.compare(c), 0);
+  EXPECT_EQ(0, a.compare("abc"));
+  EXPECT_TRUE(a < b);
+  EXPECT_TRUE(c < a);
+  EXPECT_TRUE(a != b);
+  EXPECT_TRUE("abc" == a);
+  // Different small sizes compare by their chars
+  EXPECT_TRUE(a == small_string<16>("abc"));
+}
+
+TEST(small_string, hash) {
+  const small_string<8> a("identifier"), b("identifier"), c("identifieR");
+  EXPECT_EQ(a.hash(), b.hash());
+  EXPECT_NE(a.hash(), c.hash());
+  EXPECT_NE(small_string<8>("").hash(), small_string<8>("a").hash());
+#if __cplusplus >= 201103L
+  EXPECT_EQ(a.hash(), std::hash< small_string<8> >()(a));
+#endif
+}
+
+#if __cplusplus >= 201703L
+#include <string_view>
+
+TEST(small_string, string_view) {
+  const small_string<8> s("view");
+  const std::string_view v = s;
+  EXPECT_EQ(4u, v.size());
+  EXPECT_EQ(s.data(), v.data());
+  EXPECT_EQ(s, small_string<8>(std::string_view("view")));
+}
+#endif
@@ -0,0 +1,90 @@
+// The statistics need C++11; in C++03 this file tests nothing
+#if __cplusplus >= 201103L
+#define SMALLVECTOR_STATS
+#endif
+
+#include "small_vector.h"
+#include "gtest/gtest.h"
+#include "report_output.h"
+#include <string>
+
+#ifdef SMALLVECTOR_STATS
+
+namespace {
+  // Unique element types, so that no other test touches their counters
+  struct stats_elem { int n; };
+  struct stats_elem2 { int n; };
+}
+
+TEST(stats, counts_lifetimes) {
+  small_vector_stats::dump_at_exit(false);
+  typedef small_vector<stats_elem, 2> vec_type;
+  const small_vector_stats& stats =
+    small_vector_stats::for_type<stats_elem, 2>();
+  EXPECT_EQ(2u, stats.small_size());
+  EXPECT_EQ(sizeof(stats_elem), stats.element_size());
+  EXPECT_CONTAINS(stats.element_type(), "stats_elem");
+
+  const stats_elem e = { 1 };
+  {
+    // Stays inline
+    vec_type a;
+    a.push_back(e);
+
+    // Spills to 4, then reallocates to 8
+    vec_type b;
+    for (int i=0; i<5; ++i) b.push_back(e);
+
+    // Starts out on the heap
+    vec_type c(3u, e);
+
+    // A copy counts as a construction too
+    vec_type d(a);
+  }
+
+  EXPECT_EQ(4u, stats.constructions());
+  EXPECT_EQ(4u, stats.destructions());
+  EXPECT_EQ(2u, stats.inline_lifetimes());
+  EXPECT_EQ(2u, stats.spills());
+  EXPECT_EQ(1u, stats.reallocations());
+  // 2 elements moved on the spill, 4 on the reallocation
+  EXPECT_EQ(6 * sizeof(stats_elem), stats.bytes_relocated());
+  EXPECT_EQ(5u, stats.peak_size());
+}
+
+// Going back to the small storage still counts as having spilled, and
+// the peak survives clear()
+TEST(stats, shrink_and_clear) {
+  typedef small_vector<stats_elem2, 4> vec_type;
+  const small_vector_stats& stats =
+    small_vector_stats::for_type<stats_elem2, 4>();
+  const stats_elem2 e = { 1 };
+  {
+    vec_type v;
+    for (int i=0; i<10; ++i) v.push_back(e);
+    v.clear();
+    v.shrink_to_fit();
+    EXPECT_TRUE(v.is_small());
+  }
+  EXPECT_EQ(1u, stats.destructions());
+  EXPECT_EQ(0u, stats.inline_lifetimes());
+  EXPECT_EQ(1u, stats.spills());
+  EXPECT_EQ(2u, stats.reallocations());
+  EXPECT_EQ(10u, stats.peak_size());
+}
+
+// Every instantiation shows up in the registry and the dump
+TEST(stats, registry_and_dump) {
+  bool found = false;
+  for (const small_vector_stats* s = small_vector_stats::first();
+       s; s = s->next()) {
+    if (s == &small_vector_stats::for_type<stats_elem, 2>()) found = true;
+  }
+  EXPECT_TRUE(found);
+
+  const std::string out = report_output(&small_vector_stats::dump);
+  EXPECT_CONTAINS(out, "stats_elem2");
+  EXPECT_CONTAINS(out, "peak size");
+}
+
+#endif
@@ -0,0 +1,149 @@
+// Tracing needs C++11; in C++03 this file tests nothing
+#if __cplusplus >= 201103L
+#define SMALLVECTOR_TRACE
+#endif
+
+#include "small_vector.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef SMALLVECTOR_TRACE
+#include <thread>
+#include <unistd.h>
+
+namespace {
+  typedef small_vector_trace_record record;
+
+  struct trace_elem { int n[3]; };
+
+  // A trace file in the temporary directory, removed at scope exit
+  class trace_file {
+  public:
+    trace_file() {
+      std::snprintf(m_path, sizeof(m_path), "/tmp/small_vector_trace.%d",
+                    static_cast<int>(::getpid()));
+    }
+    ~trace_file() { std::remove(m_path); }
+    const char* path() const { return m_path; }
+
+    // The records, checking the header first
+    std::vector<record> read() const {
+      std::vector<record> records;
+      std::FILE* f = std::fopen(m_path, "rb");
+      if (!f) return records;
+      small_vector_trace_header header;
+      if (std::fread(&header, sizeof(header), 1, f) == 1 &&
+          std::memcmp(header.magic, "SVTRACE", 8) == 0 &&
+          header.record_size == sizeof(record)) {
+        record r;
+        while (std::fread(&r, sizeof(r), 1, f) == 1) records.push_back(r);
+      }
+      std::fclose(f);
+      return records;
+    }
+  private:
+    char m_path[64];
+  };
+}
+
+TEST(trace, records_operations) {
+  trace_file file;
+  ASSERT_TRUE(small_vector_trace::start(file.path()));
+  {
+    const trace_elem e = { { 1, 2, 3 } };
+    small_vector<trace_elem, 2> v;
+    for (int i=0; i<3; ++i) v.push_back(e);
+    small_vector<trace_elem, 2> copy(v);
+    v.clear();
+  }
+  small_vector_trace::stop();
+
+  const std::vector<record> records = file.read();
+  const unsigned ops[] = {
+    small_vector_operation::construct, small_vector_operation::push_back,
+    small_vector_operation::push_back, small_vector_operation::push_back,
+    small_vector_operation::copy, small_vector_operation::clear,
+    small_vector_operation::destroy, small_vector_operation::destroy
+  };
+  const unsigned sizes[] = { 0, 1, 2, 3, 3, 0, 3, 0 };
+  ASSERT_EQ(8u, records.size());
+  for (int i=0; i<8; ++i) {
+    EXPECT_EQ(ops[i], records[i].op) << i;
+    EXPECT_EQ(sizes[i], records[i].size) << i;
+    EXPECT_EQ(sizeof(trace_elem), records[i].element_size);
+    EXPECT_EQ(2u, records[i].small_size);
+  }
+  // The copy is a different vector, destroyed first
+  EXPECT_EQ(records[0].vector, records[1].vector);
+  EXPECT_NE(records[0].vector, records[4].vector);
+  EXPECT_EQ(records[4].vector, records[6].vector);
+  EXPECT_EQ(records[0].vector, records[7].vector);
+}
+
+// Vectors constructed before the trace started stay out of it
+TEST(trace, untraced_vectors) {
+  small_vector<int, 2> before;
+  trace_file file;
+  ASSERT_TRUE(small_vector_trace::start(file.path()));
+  before.push_back(1);
+  {
+    small_vector<int, 2> during;
+    during.reserve(8);
+  }
+  small_vector_trace::stop();
+  before.push_back(2);
+
+  const std::vector<record> records = file.read();
+  ASSERT_EQ(3u, records.size());
+  EXPECT_EQ(unsigned(small_vector_operation::reserve), records[1].op);
+  EXPECT_EQ(8u, records[1].size);
+}
+
+// Growth inside append() is recorded as the append alone, not as a
+// reserve() the user never made
+TEST(trace, append_growth) {
+  trace_file file;
+  ASSERT_TRUE(small_vector_trace::start(file.path()));
+  {
+    const int values[10] = { 0 };
+    small_vector<int, 4> v;
+    v.append(values, values + 10);
+    v.append(values, values + 1);
+    v.append(values, values + 2, 2);
+    int* p = v.grow_uninitialized(20);
+    p[0] = 1;
+    v.commit(1);
+  }
+  small_vector_trace::stop();
+
+  const std::vector<record> records = file.read();
+  const unsigned ops[] = {
+    small_vector_operation::construct, small_vector_operation::append,
+    small_vector_operation::append, small_vector_operation::append,
+    small_vector_operation::append, small_vector_operation::destroy
+  };
+  const unsigned sizes[] = { 0, 10, 11, 13, 14, 14 };
+  ASSERT_EQ(6u, records.size());
+  for (int i=0; i<6; ++i) {
+    EXPECT_EQ(ops[i], records[i].op) << i;
+    EXPECT_EQ(sizes[i], records[i].size) << i;
+  }
+}
+
+// A thread's records are written when it exits
+TEST(trace, thread_exit_flushes) {
+  trace_file file;
+  ASSERT_TRUE(small_vector_trace::start(file.path()));
+  std::thread([] {
+    for (int i=0; i<10; ++i) {
+      small_vector<int, 4> v(3);
+    }
+  }).join();
+  small_vector_trace::stop();
+  EXPECT_EQ(20u, file.read().size());
+  EXPECT_EQ(0u, small_vector_trace::dropped());
+}
+
+#endif